@@ -22,6 +22,22 @@ buf_init(int64_t initial_capacity)
     return buf;
 }
 
+// the bytes come in the same allocation as the buf_t, for buffers that are filled once and never grow
+struct buf_t *
+buf_init_inline(int64_t capacity)
+{
+    struct buf_t *buf = (struct buf_t *) se_alloc(1, sizeof(struct buf_t) + capacity + 1);
+    buf_size += sizeof(struct buf_t) + capacity + 1;
+
+    buf->bytes = (char *) (buf + 1);
+
+    buf->length = 0;
+    buf->capacity = capacity + 1;
+    buf->rc = 0;
+
+    return buf;
+}
+
 struct buf_t *
 buf_init_fmt(const char *fmt, ...)
 {
@@ -32,11 +48,18 @@ buf_init_fmt(const char *fmt, ...)
 }
 
 // helper
+int8_t
+buf_is_inline(struct buf_t *buf, const char *bytes)
+{
+    return bytes == (const char *) (buf + 1);
+}
+
 void
 buf_ensure_free_bytes(struct buf_t *buf, int64_t capacity)
 {
     int realloc = 0;
-    while (buf->length + capacity >= buf->capacity - 1) {
+    // always leave room for the terminating nul
+    while (buf->length + capacity >= buf->capacity) {
         realloc = 1;
         buf->capacity *= 2;
     }
@@ -47,7 +70,9 @@ buf_ensure_free_bytes(struct buf_t *buf, int64_t capacity)
         buf_size += buf->capacity;
 
         memcpy(buf->bytes, old_bytes, buf->length * sizeof(char));
-        free(old_bytes);
+        if (!buf_is_inline(buf, old_bytes)) {
+            free(old_bytes);
+        }
     }
 }
 
@@ -60,7 +85,9 @@ buf_free(struct buf_t *buf)
     if (buf->rc > 0) {
         buf->rc -= 1;
     } else {
-        free(buf->bytes);
+        if (!buf_is_inline(buf, buf->bytes)) {
+            free(buf->bytes);
+        }
         free(buf);
     }
 }
@@ -170,9 +197,6 @@ buf_write_fmt_specifier(struct buf_t *buf, const char *src, va_list list)
     if (buf_write_fmt_specifier_helper(buf, src, "rope", buf_write_rope_va, list)) {
         return (int32_t) strlen("rope");
     }
-    if (buf_write_fmt_specifier_helper(buf, src, "line_rope", buf_write_line_rope_va, list)) {
-        return (int32_t) strlen("line_rope");
-    }
 
     SE_PANIC("unknown specifier");
     exit(-1);
@@ -207,7 +231,9 @@ buf_write_bytes_e(struct buf_t *buf, const char *bytes, int64_t byte_count)
 void
 buf_write_bytes_e_va(struct buf_t *buf, va_list list)
 {
-    buf_write_bytes_e(buf, va_arg(list, const char *), va_arg(list, int64_t));
+    const char *bytes = va_arg(list, const char *);
+    int64_t byte_count = va_arg(list, int64_t);
+    buf_write_bytes_e(buf, bytes, byte_count);
 }
 
 // write_bytes
@@ -224,7 +250,9 @@ buf_write_bytes(struct buf_t *buf, const char *bytes, int64_t byte_count)
 void
 buf_write_bytes_va(struct buf_t *buf, va_list list)
 {
-    buf_write_bytes(buf, va_arg(list, const char *), va_arg(list, int64_t));
+    const char *bytes = va_arg(list, const char *);
+    int64_t byte_count = va_arg(list, int64_t);
+    buf_write_bytes(buf, bytes, byte_count);
 }
 
 // write_str
@@ -278,7 +306,9 @@ buf_write_str_une(struct buf_t *buf, int64_t num_chars, const char *str)
 void
 buf_write_str_une_va(struct buf_t *buf, va_list list)
 {
-    buf_write_str_une(buf, va_arg(list, int64_t), va_arg(list, const char *));
+    int64_t num_chars = va_arg(list, int64_t);
+    const char *str = va_arg(list, const char *);
+    buf_write_str_une(buf, num_chars, str);
 }
 
 // write_char
@@ -309,7 +339,9 @@ buf_write_r_char(struct buf_t *buf, int64_t repeat_count, char c)
 void
 buf_write_r_char_va(struct buf_t *buf, va_list list)
 {
-    buf_write_r_char(buf, va_arg(list, int64_t), va_arg(list, int));
+    int64_t repeat_count = va_arg(list, int64_t);
+    char c = (char) va_arg(list, int);
+    buf_write_r_char(buf, repeat_count, c);
 }
 
 // write_i32
@@ -372,7 +404,10 @@ buf_write_vector(struct buf_t *buf, const char *elem_fmt, struct vector_t *vecto
 void
 buf_write_vector_va(struct buf_t *buf, va_list list)
 {
-    buf_write_vector(buf, va_arg(list, const char *), va_arg(list, struct vector_t *), va_arg(list, const char *));
+    const char *elem_fmt = va_arg(list, const char *);
+    struct vector_t *vector = va_arg(list, struct vector_t *);
+    const char *separator = va_arg(list, const char *);
+    buf_write_vector(buf, elem_fmt, vector, separator);
 }
 
 // write_vector_deref
@@ -391,7 +426,10 @@ buf_write_vector_deref(struct buf_t *buf, const char *elem_fmt, struct vector_t
 void
 buf_write_vector_deref_va(struct buf_t *buf, va_list list)
 {
-    buf_write_vector_deref(buf, va_arg(list, const char *), va_arg(list, struct vector_t *), va_arg(list, const char *));
+    const char *elem_fmt = va_arg(list, const char *);
+    struct vector_t *vector = va_arg(list, struct vector_t *);
+    const char *separator = va_arg(list, const char *);
+    buf_write_vector_deref(buf, elem_fmt, vector, separator);
 }
 
 // write_editor_buffer
@@ -423,12 +461,13 @@ buf_write_rope(struct buf_t *buf, struct rope_t *rn)
     }
 
     if (rn->is_leaf) {
-        buf_write_bytes(buf, rn->str_buf->bytes, rn->byte_weight);
+        buf_write_bytes(buf, rope_leaf_bytes(rn), rn->total_byte_weight);
         return;
     }
 
-    buf_write_rope(buf, rn->left);
-    buf_write_rope(buf, rn->right);
+    for (int8_t k = 0; k < rn->child_count; k++) {
+        buf_write_rope(buf, rn->children[k]);
+    }
 }
 
 void
@@ -449,19 +488,21 @@ buf_write_rope_debug_helper(struct buf_t *buf, struct rope_t *rn, int32_t indent
     if (rn->is_leaf) {
         buf_write_fmt(buf, "%r_char{byte_weight: %i64, char_weight: %i64}[rc:%i32] %bytes_e\n",
                       indent, ' ',
-                      rn->byte_weight,
-                      rn->char_weight,
+                      rn->total_byte_weight,
+                      rn->total_char_weight,
                       rn->rc,
-                      rn->str_buf->bytes, rn->byte_weight);
+                      rope_leaf_bytes(rn), rn->total_byte_weight);
     } else {
-        buf_write_fmt(buf, "%r_char{byte_weight: %i64, char_weight: %i64}[rc:%i32]\n",
+        buf_write_fmt(buf, "%r_char{byte_weight: %i64, char_weight: %i64, children: %i32}[rc:%i32]\n",
                       indent, ' ',
-                      rn->byte_weight,
-                      rn->char_weight,
+                      rn->total_byte_weight,
+                      rn->total_char_weight,
+                      (int32_t) rn->child_count,
                       rn->rc);
 
-        buf_write_rope_debug_helper(buf, rn->left, indent + 2);
-        buf_write_rope_debug_helper(buf, rn->right, indent + 2);
+        for (int8_t k = 0; k < rn->child_count; k++) {
+            buf_write_rope_debug_helper(buf, rn->children[k], indent + 2);
+        }
     }
 }
 
@@ -476,37 +517,3 @@ buf_write_rope_debug_va(struct buf_t *buf, va_list list)
 {
     buf_write_rope_debug(buf, va_arg(list, struct rope_t *));
 }
-
-void
-buf_write_line_rope_helper(struct buf_t *buf, struct line_rope_t *line_rope, int64_t indent)
-{
-    if (line_rope == NULL) {
-        buf_write_fmt(buf, "%r_char{NULL}\n", indent, ' ');
-        return;
-    }
-
-    buf_write_fmt(buf, "%r_char{line_length: %i64, virtual_newline_count: %u32, total_virtual_newline_count: %i64}[rc:%i32]\n",
-                  indent, ' ',
-                  line_rope->line_length,
-                  line_rope->virtual_newline_count,
-                  line_rope->total_virtual_newline_count,
-                  line_rope->rc);
-
-    if (!line_rope->is_leaf) {
-        buf_write_line_rope_helper(buf, line_rope->left, indent + 2);
-        buf_write_line_rope_helper(buf, line_rope->right, indent + 2);
-    }
-}
-
-void
-buf_write_line_rope(struct buf_t *buf, struct line_rope_t *line_rope)
-{
-    buf_write_line_rope_helper(buf, line_rope, 0);
-}
-
-void
-buf_write_line_rope_va(struct buf_t *buf, va_list list)
-{
-    buf_write_line_rope(buf, va_arg(list, struct line_rope_t *));
-}
-
@@ -24,10 +24,16 @@ typedef void (*write_fn_t)(struct buf_t *buf, va_list list);
 struct buf_t *
 buf_init(int64_t initial_capacity);
 
+struct buf_t *
+buf_init_inline(int64_t capacity);
+
 struct buf_t *
 buf_init_fmt(const char *fmt, ...);
 
 // methods
+int8_t
+buf_is_inline(struct buf_t *buf, const char *bytes);
+
 void
 buf_ensure_free_bytes(struct buf_t *buf, int64_t capacity);
 
@@ -143,8 +149,4 @@ buf_write_rope_debug(struct buf_t *buf, struct rope_t *rn);
 void
 buf_write_rope_debug_va(struct buf_t *buf, va_list list);
 
-// write line_rope
-void
-buf_write_line_rope_va(struct buf_t *buf, va_list list);
-
 #endif //SWL_BUF_H
@@ -4,11 +4,25 @@
 #include "rope.h"
 #include "circular_buffer.h"
 #include "buf.h"
-#include "line_rope.h"
 #include "stack.h"
+#include "node_pool.h"
 
 void
-editor_screen_set_line_and_col_for_char_pos(struct cursor_info_t *cursor_info, struct rope_t *text);
+editor_screen_set_line_and_col_for_char_pos(struct cursor_info_t *cursor_info, struct rope_t *text,
+                                            struct rope_finger_t *finger);
+
+void
+editor_buffer_insert_at_cursors(struct editor_buffer_t editor_buffer, const char *text, struct rope_t *rope);
+
+void
+editor_buffer_mark_saved(struct editor_buffer_t editor_buffer);
+
+void
+editor_buffer_replace_current_text(struct editor_buffer_t editor_buffer, struct rope_t *text);
+
+int64_t
+editor_buffer_char_pos_for_wrap_point(struct rope_t *text, const struct rope_wrap_point_t *point, int64_t col,
+                                      int64_t virtual_line_length);
 
 struct editor_buffer_t
 editor_buffer_create(uint32_t virtual_line_length)
@@ -31,6 +45,19 @@ editor_buffer_create(uint32_t virtual_line_length)
 
     editor_buffer.current_screen = se_alloc(1, sizeof(struct editor_screen_t));
 
+    editor_buffer.finger = se_alloc(1, sizeof(struct rope_finger_t));
+    rope_finger_reset(editor_buffer.finger);
+
+    editor_buffer.saved_hash = se_alloc(1, sizeof(uint64_t));
+    editor_buffer.saved_byte_length = se_alloc(1, sizeof(int64_t));
+
+    editor_buffer.compact_position = se_alloc(1, sizeof(int64_t));
+    editor_buffer.compact_text = se_alloc(1, sizeof(struct rope_t *));
+
+    editor_buffer.rope_pool = node_pool_init(rope_node_size(0));
+    editor_buffer.rope_leaf_pool = node_pool_init(rope_node_size(1));
+    editor_buffer_use_node_pools(editor_buffer);
+
     struct editor_screen_t screen;
 
     struct cursor_info_t cursor_info;
@@ -43,12 +70,10 @@ editor_buffer_create(uint32_t virtual_line_length)
     vector_append(screen.cursor_infos, &cursor_info);
 
     screen.text = rope_leaf_init("");
-
-    // todo(chad): initialize this only if the number of lines is less than a certain threshold
-    screen.lines = line_rope_leaf_init(0, virtual_line_length);
-//    screen.lines = NULL;
+    ensure_virtual_newline_length(screen.text, virtual_line_length);
 
     undo_stack_append(editor_buffer, screen);
+    editor_buffer_mark_saved(editor_buffer);
 
     return editor_buffer;
 }
@@ -59,29 +84,37 @@ editor_buffer_get_current_screen(struct editor_buffer_t editor_buffer)
     return *editor_buffer.current_screen;
 }
 
+void
+editor_buffer_use_node_pools(struct editor_buffer_t editor_buffer)
+{
+    rope_pool = editor_buffer.rope_pool;
+    rope_leaf_pool = editor_buffer.rope_leaf_pool;
+}
+
 void
 editor_buffer_destroy(struct editor_buffer_t editor_buffer)
 {
-    for (int64_t i = 0; i < editor_buffer.undo_buffer->length; i++) {
-        struct editor_screen_t *screen = circular_buffer_at(editor_buffer.undo_buffer, i);
-        rope_dec_rc(screen->text);
-        line_rope_dec_rc(screen->lines);
-    }
+    if (rope_pool == editor_buffer.rope_pool) { rope_pool = NULL; }
+    if (rope_leaf_pool == editor_buffer.rope_leaf_pool) { rope_leaf_pool = NULL; }
 
-    for (int64_t i = 0; i < editor_buffer.global_undo_buffer->length; i++) {
-        struct editor_screen_t *screen = circular_buffer_at(editor_buffer.undo_buffer, i);
-        rope_dec_rc(screen->text);
-        line_rope_dec_rc(screen->lines);
-    }
+    // every node of every undo snapshot is in the buffer's pools, so rather than walk the snapshots
+    // dropping references, let go of the leaves' buffers and free the pools whole
+    node_pool_release(editor_buffer.rope_pool, NULL);
+    node_pool_release(editor_buffer.rope_leaf_pool, rope_release_node);
 
     free(editor_buffer.undo_idx);
     free(editor_buffer.global_undo_idx);
 
     free(editor_buffer.current_screen);
+    free(editor_buffer.finger);
+    free(editor_buffer.saved_hash);
+    free(editor_buffer.saved_byte_length);
+    free(editor_buffer.compact_position);
+    free(editor_buffer.compact_text);
 }
 
 struct rope_t *
-read_file(const char *file_path, struct line_helper_t *line_helper)
+read_file(const char *file_path)
 {
     FILE *file = fopen(file_path, "r");
     if (file == NULL) {
@@ -121,55 +154,26 @@ read_file(const char *file_path, struct line_helper_t *line_helper)
         fprintf(stderr, "warning: failure closing file\n");
     }
 
-    struct rope_t *rn = rope_leaf_init_lines(src, line_helper);
+    struct rope_t *rn = rope_leaf_init(src);
+    if (rope_has_replacement_chars(rn)) {
+        fprintf(stderr, "warning: %s isn't valid utf-8, the invalid bytes were replaced\n", file_path);
+    }
 
     free(src);
 
     return rn;
 }
 
-int64_t
-editor_screen_calculate_line_length(struct editor_screen_t screen, int64_t line)
-{
-    int64_t char_number_at_current_line = rope_char_number_at_line(screen.text, line);
-    int64_t char_number_at_next_line = rope_char_number_at_line(screen.text, line + 1);
-    int64_t answer = (int64_t) (char_number_at_next_line - char_number_at_current_line - 1);
-    if (answer < 0) { answer = 0; }
-    return answer;
-}
-
 void
-editor_screen_balance_lines_if_needed(struct editor_screen_t *screen)
+ensure_virtual_newline_length(struct rope_t *rn, int64_t virtual_line_length)
 {
-    // todo(chad): come up with an actual condition here
-
-    struct line_rope_t *new_lines = line_rope_balance(screen->lines);
-    line_rope_free(screen->lines);
-    screen->lines = new_lines;
-}
-
-void
-ensure_virtual_newline_length(struct line_rope_t *rn, int64_t virtual_line_length)
-{
-    if (rn == NULL) { return; }
-
-    if (rn->virtual_line_length == virtual_line_length) { return; }
-
-    rn->virtual_line_length = (uint32_t) virtual_line_length;
-
-    if (!rn->is_leaf) {
-        ensure_virtual_newline_length(rn->left, virtual_line_length);
-        ensure_virtual_newline_length(rn->right, virtual_line_length);
-    }
-
-    rn->virtual_newline_count = line_rope_virtual_newline_weight(rn);
-    rn->total_virtual_newline_count = line_rope_total_virtual_newline_weight(rn);
+    rope_update_line_summary(rn, virtual_line_length);
 }
 
 void
 editor_buffer_open_file(struct editor_buffer_t editor_buffer, uint32_t virtual_line_length, const char *file_path)
 {
-    ensure_virtual_newline_length(editor_buffer.current_screen->lines, virtual_line_length);
+    editor_buffer_use_node_pools(editor_buffer);
 
     struct editor_screen_t screen;
 
@@ -182,82 +186,11 @@ editor_buffer_open_file(struct editor_buffer_t editor_buffer, uint32_t virtual_l
     screen.cursor_infos = vector_init(16, sizeof(struct cursor_info_t));
     vector_append(screen.cursor_infos, &cursor_info);
 
-    struct vector_t *lines_vector = vector_init(64, sizeof(int64_t));
-    struct line_helper_t line_helper;
-    line_helper.lines = lines_vector;
-    line_helper.leftover = 0;
-
-    screen.text = read_file(file_path, &line_helper);
-    int64_t total_line_lengths = 0;
-
-    struct vector_t *stack = stack_init(sizeof(struct line_rope_t *));
-
-    int64_t line = 0;
-    int64_t char_number_at_current_line = 0;
-
-    int64_t char_number_at_next_line;
-    if (line >= lines_vector->length) {
-        char_number_at_next_line = rope_total_char_length(screen.text) + 1;
-    } else {
-        int64_t line_length = *(int64_t *) vector_at(lines_vector, line);
-        total_line_lengths += line_length;
-        char_number_at_next_line = total_line_lengths;
-    }
-
-    struct line_rope_t *rn = line_rope_leaf_init(
-            (uint32_t) (char_number_at_next_line - char_number_at_current_line - 1),
-            virtual_line_length);
-    stack_push(stack, &rn);
-    line += 1;
-    int64_t lines = 1 + rope_total_line_break_length(screen.text);
-    while (line < lines) {
-        char_number_at_current_line = char_number_at_next_line;
-
-        if (line >= lines_vector->length) {
-            char_number_at_next_line = rope_total_char_length(screen.text) + 1;
-        } else {
-            int64_t line_length = *(int64_t *) vector_at(lines_vector, line);
-            total_line_lengths += line_length - 1;
-            char_number_at_next_line = total_line_lengths;
-        }
-
-        rn = line_rope_leaf_init((uint32_t) (char_number_at_next_line - char_number_at_current_line - 1), virtual_line_length);
-        stack_push(stack, &rn);
-
-        int8_t c = 0;
-        while (stack->length > 1 && !c) {
-            struct line_rope_t *top = (struct line_rope_t *) vector_at_deref(stack, stack->length - 1);
-            struct line_rope_t *second = (struct line_rope_t *) vector_at_deref(stack, stack->length - 2);
-            if (top->height == second->height) {
-                stack_pop(stack);
-                stack_pop(stack);
-
-                struct line_rope_t *new_line = line_rope_parent_init(second, top, virtual_line_length);
-                stack_push(stack, &new_line);
-            } else {
-                c = 1;
-            }
-        }
-
-        line += 1;
-    }
-
-    vector_free(lines_vector);
-
-    while (stack->length > 1) {
-        struct line_rope_t *top = (struct line_rope_t *) vector_at_deref(stack, stack->length - 1);
-        struct line_rope_t *second = (struct line_rope_t *) vector_at_deref(stack, stack->length - 2);
-        stack_pop(stack);
-        stack_pop(stack);
-
-        struct line_rope_t *new_line = line_rope_parent_init(second, top, rn->virtual_line_length);
-        stack_push(stack, &new_line);
-    }
-    SE_ASSERT(stack->length == 1);
-    screen.lines = (struct line_rope_t *) stack_pop_deref(stack);
-    vector_free(stack);
+    screen.text = read_file(file_path);
+    ensure_virtual_newline_length(screen.text, virtual_line_length);
 
     undo_stack_append(editor_buffer, screen);
+    editor_buffer_mark_saved(editor_buffer);
 
     // todo(chad): @Leak
     *editor_buffer.file_path = *buf_init_fmt("%str", file_path);
@@ -298,6 +231,10 @@ editor_buffer_save_file_as(struct editor_buffer_t editor_buffer, const char *fil
 
     fclose(file);
 
+    if (err >= 0) {
+        editor_buffer_mark_saved(editor_buffer);
+    }
+
     return err;
 }
 
@@ -307,6 +244,23 @@ editor_buffer_has_file_path(struct editor_buffer_t editor_buffer)
     return editor_buffer.file_path->length > 0;
 }
 
+void
+editor_buffer_mark_saved(struct editor_buffer_t editor_buffer)
+{
+    *editor_buffer.saved_hash = rope_hash(editor_buffer.current_screen->text);
+    *editor_buffer.saved_byte_length = rope_total_byte_length(editor_buffer.current_screen->text);
+}
+
+// compares hashes rather than snapshots, so undoing back to the saved text, or typing something and then
+// deleting it again, counts as unmodified
+int8_t
+editor_buffer_is_modified(struct editor_buffer_t editor_buffer)
+{
+    struct rope_t *text = editor_buffer.current_screen->text;
+    return rope_total_byte_length(text) != *editor_buffer.saved_byte_length
+           || rope_hash(text) != *editor_buffer.saved_hash;
+}
+
 struct cursor_info_t *
 possibly_merge_cursors(struct cursor_info_t *i, struct cursor_info_t *j)
 {
@@ -452,9 +406,10 @@ sort_and_merge_cursors(struct editor_buffer_t editor_buffer)
 void
 editor_buffer_delete_possibly_only_selection(struct editor_buffer_t editor_buffer, int8_t should_delete_non_selection)
 {
+    editor_buffer_use_node_pools(editor_buffer);
+
     struct editor_screen_t edited_screen;
     edited_screen.cursor_infos = vector_copy(editor_buffer.current_screen->cursor_infos);
-    edited_screen.lines = line_rope_shallow_copy(editor_buffer.current_screen->lines);
     edited_screen.text = rope_shallow_copy(editor_buffer.current_screen->text);
 
     for (int64_t i = edited_screen.cursor_infos->length - 1; i >= 0; i--) {
@@ -462,12 +417,9 @@ editor_buffer_delete_possibly_only_selection(struct editor_buffer_t editor_buffe
 
         if (cursor_info->char_pos == 0 && !cursor_info->is_selection) {
             cursor_info->selection_char_pos = 0;
-            cursor_info->selection_row = 0;
             continue;
         }
 
-        int64_t start_row;
-
         int64_t delete_from;
         int64_t delete_to;
         if (cursor_info->is_selection) {
@@ -477,19 +429,13 @@ editor_buffer_delete_possibly_only_selection(struct editor_buffer_t editor_buffe
             if (cursor < selection) {
                 delete_from = cursor;
                 delete_to = selection;
-
-                start_row = cursor_info->selection_row;
             } else {
                 delete_from = selection;
                 delete_to = cursor;
-
-                start_row = cursor_info->row;
             }
         } else {
             delete_from = cursor_info->char_pos - 1;
             delete_to = cursor_info->char_pos;
-
-            start_row = cursor_info->row;
         }
 
         if (!should_delete_non_selection && !cursor_info->is_selection) {
@@ -528,13 +474,9 @@ editor_buffer_delete_possibly_only_selection(struct editor_buffer_t editor_buffe
         } else {
             cursor_info->selection_char_pos = 1;
         }
-
-        // more hackery
-        cursor_info->selection_row = start_row;
     }
 
     int64_t total = 0;
-    int64_t lines_deleted = 0;
     for (int64_t i = 0; i < edited_screen.cursor_infos->length; i++) {
         struct cursor_info_t *cursor_info = (struct cursor_info_t *) vector_at(edited_screen.cursor_infos, i);
         total += cursor_info->selection_char_pos;
@@ -543,38 +485,7 @@ editor_buffer_delete_possibly_only_selection(struct editor_buffer_t editor_buffe
             cursor_info->char_pos = 0;
         }
 
-        editor_screen_set_line_and_col_for_char_pos(cursor_info, edited_screen.text);
-
-        int64_t end_row = cursor_info->row;
-        if (end_row + lines_deleted != cursor_info->selection_row) {
-            struct line_rope_t *saved_lines = edited_screen.lines;
-            
-            SE_ASSERT(end_row + lines_deleted < cursor_info->selection_row);
-            edited_screen.lines = line_rope_delete(edited_screen.lines, end_row + lines_deleted, cursor_info->selection_row);
-            line_rope_free(saved_lines);
-
-            lines_deleted = cursor_info->selection_row - end_row;
-            int64_t new_line_length = editor_screen_calculate_line_length(edited_screen, end_row);
-
-            saved_lines = edited_screen.lines;
-            edited_screen.lines = line_rope_replace_char_at(edited_screen.lines, end_row, new_line_length);
-            line_rope_free(saved_lines);
-            
-            int64_t total_lines = 1 + rope_total_line_break_length(edited_screen.text);
-            if (end_row + 1 < total_lines) {
-                new_line_length = editor_screen_calculate_line_length(edited_screen, end_row + 1);
-
-                saved_lines = edited_screen.lines;
-                edited_screen.lines = line_rope_replace_char_at(edited_screen.lines, end_row + 1, new_line_length);
-                line_rope_free(saved_lines);
-            }
-        } else {
-            int64_t new_line_length = editor_screen_calculate_line_length(edited_screen, end_row);
-
-            struct line_rope_t *saved_lines = edited_screen.lines;
-            edited_screen.lines = line_rope_replace_char_at(edited_screen.lines, end_row, new_line_length);
-            line_rope_free(saved_lines);
-        }
+        editor_screen_set_line_and_col_for_char_pos(cursor_info, edited_screen.text, NULL);
     }
 
     undo_stack_append(editor_buffer, edited_screen);
@@ -606,12 +517,13 @@ editor_buffer_delete_at_point(struct editor_buffer_t editor_buffer, int64_t num_
 {
     if (num_chars <= 0) { return; }
 
+    editor_buffer_use_node_pools(editor_buffer);
+
     struct editor_screen_t edited_screen;
 
     edited_screen.cursor_infos = vector_init(1, sizeof(struct cursor_info_t));
     struct vector_t *old_cursor_infos = vector_copy(editor_buffer.current_screen->cursor_infos);
 
-    edited_screen.lines = line_rope_shallow_copy(editor_buffer.current_screen->lines);
     edited_screen.text = rope_shallow_copy(editor_buffer.current_screen->text);
 
     struct cursor_info_t cursor_info;
@@ -622,7 +534,7 @@ editor_buffer_delete_at_point(struct editor_buffer_t editor_buffer, int64_t num_
         cursor_info.char_pos = editor_buffer_character_position_for_point(editor_buffer, row, col);
     }
 
-    editor_screen_set_line_and_col_for_char_pos(&cursor_info, edited_screen.text);
+    editor_screen_set_line_and_col_for_char_pos(&cursor_info, edited_screen.text, NULL);
 
     cursor_info.selection_char_pos = cursor_info.char_pos;
     cursor_info.selection_row = cursor_info.row;
@@ -632,11 +544,12 @@ editor_buffer_delete_at_point(struct editor_buffer_t editor_buffer, int64_t num_
     cursor_info.char_pos -= num_chars;
     if (cursor_info.char_pos < 0) { cursor_info.char_pos = 0; }
 
-    editor_screen_set_line_and_col_for_char_pos(&cursor_info, edited_screen.text);
+    editor_screen_set_line_and_col_for_char_pos(&cursor_info, edited_screen.text, NULL);
 
     vector_append(edited_screen.cursor_infos, &cursor_info);
 
     *editor_buffer.current_screen = edited_screen;
+    rope_finger_reset(editor_buffer.finger);
     editor_buffer_delete(editor_buffer);
 
     free(edited_screen.cursor_infos);
@@ -647,7 +560,7 @@ editor_buffer_delete_at_point(struct editor_buffer_t editor_buffer, int64_t num_
         if (ci->char_pos > cursor_info.char_pos) {
             ci->char_pos -= num_chars;
             if (ci->char_pos < 0) { ci->char_pos = 0; }
-            editor_screen_set_line_and_col_for_char_pos(ci, editor_buffer.current_screen->text);
+            editor_screen_set_line_and_col_for_char_pos(ci, editor_buffer.current_screen->text, editor_buffer.finger);
         }
     }
 }
@@ -655,6 +568,26 @@ editor_buffer_delete_at_point(struct editor_buffer_t editor_buffer, int64_t num_
 void
 editor_buffer_insert(struct editor_buffer_t editor_buffer, const char *text)
 {
+    editor_buffer_insert_at_cursors(editor_buffer, text, NULL);
+}
+
+void
+editor_buffer_insert_rope(struct editor_buffer_t editor_buffer, struct rope_t *rope)
+{
+    editor_buffer_use_node_pools(editor_buffer);
+
+    // a rope from another buffer lives in that buffer's pools, which go away with it
+    struct rope_t *own = rope_copy_into_current_pools(rope);
+    editor_buffer_insert_at_cursors(editor_buffer, NULL, own);
+    rope_free(own);
+}
+
+// inserts rope if it's given, and text if it isn't
+void
+editor_buffer_insert_at_cursors(struct editor_buffer_t editor_buffer, const char *text, struct rope_t *rope)
+{
+    editor_buffer_use_node_pools(editor_buffer);
+
     int8_t exists_selection = 0;
     for (int64_t i = editor_buffer.current_screen->cursor_infos->length - 1; i >= 0; i--) {
         struct cursor_info_t *cursor_info = (struct cursor_info_t *) vector_at(editor_buffer.current_screen->cursor_infos, i);
@@ -670,52 +603,31 @@ editor_buffer_insert(struct editor_buffer_t editor_buffer, const char *text)
 
     struct editor_screen_t edited_screen;
     edited_screen.cursor_infos = vector_copy(editor_buffer.current_screen->cursor_infos);
-    edited_screen.lines = line_rope_shallow_copy(editor_buffer.current_screen->lines);
     edited_screen.text = rope_shallow_copy(editor_buffer.current_screen->text);
 
+    int64_t inserted_char_count = 0;
     for (int64_t i = edited_screen.cursor_infos->length - 1; i >= 0; i--) {
         struct cursor_info_t *cursor_info = (struct cursor_info_t *) vector_at(edited_screen.cursor_infos, i);
 
-        int64_t cursor_line_before = cursor_info->row;
+        int64_t char_count_before = rope_total_char_length(edited_screen.text);
 
-        struct rope_t *edited = rope_insert(edited_screen.text, cursor_info->char_pos, text);
+        struct rope_t *edited;
+        if (rope != NULL) {
+            edited = rope_insert_rope(edited_screen.text, cursor_info->char_pos, rope);
+        } else {
+            edited = rope_insert(edited_screen.text, cursor_info->char_pos, text);
+        }
         rope_free(edited_screen.text);
         edited_screen.text = edited;
 
-        // todo(chad): @Performance
-        // count_newlines might take a while in some cases?
-        // plus we already had to do it inside the rope_insert() above
-        // could find a way to preserve that value so we don't do it twice
-        int64_t cursor_line_after = cursor_info->row + count_newlines(text);
-
-        int64_t line = cursor_line_before;
-        int64_t line_length = editor_screen_calculate_line_length(edited_screen, line);
-
-        struct line_rope_t *saved_lines = edited_screen.lines;
-        edited_screen.lines = line_rope_replace_char_at(edited_screen.lines,
-                                                        line,
-                                                        line_length);
-        line_rope_free(saved_lines);
-
-        line += 1;
-        while (line <= cursor_line_after) {
-            line_length = editor_screen_calculate_line_length(edited_screen, line);
-
-            struct line_rope_t *new_lines = line_rope_insert(edited_screen.lines,
-                                                             line,
-                                                             line_length);
-            line_rope_free(edited_screen.lines);
-            edited_screen.lines = new_lines;
-
-            line += 1;
-        }
+        inserted_char_count = rope_total_char_length(edited_screen.text) - char_count_before;
     }
 
     for (int64_t i = edited_screen.cursor_infos->length - 1; i >= 0; i--) {
         struct cursor_info_t *cursor_info = (struct cursor_info_t *) vector_at(edited_screen.cursor_infos, i);
         // position cursor at the end of the insertion
-        cursor_info->char_pos += (i + 1) * unicode_strlen(text);
-        editor_screen_set_line_and_col_for_char_pos(cursor_info, edited_screen.text);
+        cursor_info->char_pos += (i + 1) * inserted_char_count;
+        editor_screen_set_line_and_col_for_char_pos(cursor_info, edited_screen.text, NULL);
     }
 
     undo_stack_append(editor_buffer, edited_screen);
@@ -737,13 +649,12 @@ editor_buffer_insert_at_point(struct editor_buffer_t editor_buffer, const char *
                               int64_t row, int64_t col,
                               int8_t virtual, int64_t virtual_line_length)
 {
+    editor_buffer_use_node_pools(editor_buffer);
+
     struct editor_screen_t edited_screen = *editor_buffer.current_screen;
     edited_screen.cursor_infos = vector_copy(editor_buffer.current_screen->cursor_infos);
-    edited_screen.lines = line_rope_shallow_copy(editor_buffer.current_screen->lines);
     edited_screen.text = rope_shallow_copy(editor_buffer.current_screen->text);
 
-    int64_t cursor_line_before = row;
-
     int64_t char_pos;
     if (virtual) {
         char_pos = editor_buffer_character_position_for_virtual_point(editor_buffer, row, col, virtual_line_length);
@@ -751,45 +662,21 @@ editor_buffer_insert_at_point(struct editor_buffer_t editor_buffer, const char *
         char_pos = editor_buffer_character_position_for_point(editor_buffer, row, col);
     }
 
+    int64_t char_count_before = rope_total_char_length(edited_screen.text);
+
     struct rope_t *edited = rope_insert(edited_screen.text, char_pos, text);
     rope_free(edited_screen.text);
     edited_screen.text = edited;
 
-    // todo(chad): @Performance
-    // count_newlines might take a while in some cases?
-    // plus we already had to do it inside the rope_insert() above
-    // could find a way to preserve that value so we don't do it twice
-    int64_t cursor_line_after = row + count_newlines(text);
-
-    int64_t line = cursor_line_before;
-    int64_t line_length = editor_screen_calculate_line_length(edited_screen, line);
-
-    struct line_rope_t *saved_lines = edited_screen.lines;
-    edited_screen.lines = line_rope_replace_char_at(edited_screen.lines,
-                                                    line,
-                                                    line_length);
-    line_rope_free(saved_lines);
-
-    line += 1;
-    while (line <= cursor_line_after) {
-        line_length = editor_screen_calculate_line_length(edited_screen, line);
-
-        struct line_rope_t *new_lines = line_rope_insert(edited_screen.lines,
-                                                         line,
-                                                         line_length);
-        line_rope_free(edited_screen.lines);
-        edited_screen.lines = new_lines;
-
-        line += 1;
-    }
+    int64_t inserted_char_count = rope_total_char_length(edited_screen.text) - char_count_before;
 
     for (int64_t i = edited_screen.cursor_infos->length - 1; i >= 0; i--) {
         struct cursor_info_t *cursor_info = (struct cursor_info_t *) vector_at(edited_screen.cursor_infos, i);
 
         if (cursor_info->char_pos >= char_pos) {
             // advance cursor by length of the insertion
-            cursor_info->char_pos += unicode_strlen(text);
-            editor_screen_set_line_and_col_for_char_pos(cursor_info, edited_screen.text);
+            cursor_info->char_pos += inserted_char_count;
+            editor_screen_set_line_and_col_for_char_pos(cursor_info, edited_screen.text, NULL);
         }
     }
 
@@ -810,6 +697,7 @@ editor_buffer_undo(struct editor_buffer_t editor_buffer, int64_t undo_idx)
 
     struct editor_screen_t *undone_screen = circular_buffer_at(editor_buffer.undo_buffer, computed_index);
     *editor_buffer.current_screen = *undone_screen;
+    rope_finger_reset(editor_buffer.finger);
 
     *editor_buffer.undo_idx = computed_index;
     *editor_buffer.global_undo_idx = editor_buffer.global_undo_buffer->length - 1;
@@ -832,58 +720,94 @@ editor_buffer_global_undo(struct editor_buffer_t editor_buffer, int64_t undo_idx
     *editor_buffer.global_undo_idx = computed_index;
     *editor_buffer.undo_idx = editor_buffer.undo_buffer->length - 1;
     *editor_buffer.current_screen = *undone_screen;
+    rope_finger_reset(editor_buffer.finger);
 }
 
-int64_t
-editor_buffer_get_line_count(struct editor_buffer_t editor_buffer)
+int8_t
+editor_buffer_compact(struct editor_buffer_t editor_buffer, int64_t leaf_budget)
 {
-    return 1 + rope_total_line_break_length(editor_buffer.current_screen->text);
+    struct rope_t *text = editor_buffer.current_screen->text;
+
+    // the text has been edited (or undone) since the last step, so the pass starts over
+    if (text != *editor_buffer.compact_text) {
+        *editor_buffer.compact_position = 0;
+        *editor_buffer.compact_text = text;
+    }
+    if (*editor_buffer.compact_position >= rope_total_char_length(text)) { return 0; }
+
+    editor_buffer_use_node_pools(editor_buffer);
+
+    struct rope_t *compacted = rope_compact_step(text, editor_buffer.compact_position, leaf_budget);
+    if (compacted != NULL) {
+        editor_buffer_replace_current_text(editor_buffer, compacted);
+        *editor_buffer.compact_text = editor_buffer.current_screen->text;
+    }
+
+    return *editor_buffer.compact_position < rope_total_char_length(editor_buffer.current_screen->text);
 }
 
-int64_t
-line_rope_char_at_virtual_newline(struct line_rope_t *rn, int64_t i)
+// swaps the current text for a rope holding the same text, without adding an undo step. the undo entries that
+// held the old one hold the new one instead
+void
+editor_buffer_replace_current_text(struct editor_buffer_t editor_buffer, struct rope_t *text)
 {
-    if (rn == NULL) { return -1; }
+    struct rope_t *old_text = editor_buffer.current_screen->text;
 
-    if (rn->is_leaf) {
-        if ((int64_t) rn->virtual_newline_count - 1 < i) {
-            return 0;
-        }
+    struct circular_buffer_t *undo_buffers[2] = {editor_buffer.undo_buffer, editor_buffer.global_undo_buffer};
+    int64_t undo_indices[2] = {*editor_buffer.undo_idx, *editor_buffer.global_undo_idx};
+
+    struct editor_screen_t *entries[2];
+    int64_t entry_count = 0;
+    for (int64_t i = 0; i < 2; i++) {
+        if (undo_indices[i] < 0 || undo_indices[i] >= undo_buffers[i]->length) { continue; }
 
-        return 0;
+        struct editor_screen_t *entry = circular_buffer_at(undo_buffers[i], undo_indices[i]);
+        if (entry->text == old_text) { entries[entry_count++] = entry; }
     }
 
-    if ((int64_t) rn->virtual_newline_count - 1 < i) {
-        return rn->char_weight + line_rope_char_at_virtual_newline(rn->right, i - rn->virtual_newline_count);
-    } else {
-        if (rn->left != NULL) {
-            return line_rope_char_at_virtual_newline(rn->left, i);
-        }
-        return 0;
+    if (entry_count == 0) {
+        // nothing would be holding on to it
+        rope_free(text);
+        return;
     }
-}
 
-int64_t
-virtual_newline_total(struct line_rope_t *rn, int64_t line)
-{
-    if (rn == NULL) { return -1; }
+    // a snapshot's cursor_infos go along with the last reference to its text (see screen_free). if older entries
+    // keep the old text, they keep the old cursor_infos too, and the entries moving over get copies
+    int8_t copying = old_text->rc > entry_count;
+    struct vector_t *copied_from[2] = {NULL, NULL};
+    struct vector_t *copies[2] = {NULL, NULL};
+
+    for (int64_t i = 0; i < entry_count; i++) {
+        struct editor_screen_t *entry = entries[i];
 
-    if (rn->is_leaf) {
-        if ((int64_t) rn->char_weight - 1 < line) {
-            return 0;
+        if (copying) {
+            int64_t c = 0;
+            while (copied_from[c] != NULL && copied_from[c] != entry->cursor_infos) { c++; }
+            if (copied_from[c] == NULL) {
+                copied_from[c] = entry->cursor_infos;
+                copies[c] = vector_copy(entry->cursor_infos);
+            }
+            entry->cursor_infos = copies[c];
         }
 
-        return rn->total_virtual_newline_count;
+        rope_inc_rc(text);
+        entry->text = text;
+        rope_dec_rc(old_text);
     }
 
-    if ((int64_t) rn->char_weight - 1 < line) {
-        return rn->virtual_newline_count + virtual_newline_total(rn->right, line - rn->char_weight);
-    } else {
-        if (rn->left != NULL) {
-            return virtual_newline_total(rn->left, line);
+    for (int64_t c = 0; c < 2; c++) {
+        if (copied_from[c] != NULL && editor_buffer.current_screen->cursor_infos == copied_from[c]) {
+            editor_buffer.current_screen->cursor_infos = copies[c];
         }
-        return 0;
     }
+    editor_buffer.current_screen->text = text;
+    rope_finger_reset(editor_buffer.finger);
+}
+
+int64_t
+editor_buffer_get_line_count(struct editor_buffer_t editor_buffer)
+{
+    return 1 + rope_total_line_break_length(editor_buffer.current_screen->text);
 }
 
 int64_t
@@ -911,26 +835,30 @@ editor_buffer_character_position_for_virtual_point(struct editor_buffer_t editor
                                                    int64_t col,
                                                   int64_t virtual_line_length)
 {
-    ensure_virtual_newline_length(editor_buffer.current_screen->lines, virtual_line_length);
+    ensure_virtual_newline_length(editor_buffer.current_screen->text, virtual_line_length);
 
-    int64_t current_line = line_rope_char_at_virtual_newline(editor_buffer.current_screen->lines, line);
-    int64_t current_line_length = editor_buffer_get_line_length(editor_buffer, current_line);
+    struct rope_wrap_point_t point;
+    rope_wrap_locate_row(editor_buffer.current_screen->text, virtual_line_length, line, &point);
+
+    return editor_buffer_char_pos_for_wrap_point(editor_buffer.current_screen->text, &point, col, virtual_line_length);
+}
 
-    int64_t virtual_newlines_before_current_line = 0;
-    if (current_line > 0) {
-        virtual_newlines_before_current_line = virtual_newline_total(editor_buffer.current_screen->lines, current_line - 1);
+// the char at col on a located row
+int64_t
+editor_buffer_char_pos_for_wrap_point(struct rope_t *text, const struct rope_wrap_point_t *point, int64_t col,
+                                      int64_t virtual_line_length)
+{
+    if (!ROPE_WRAP_IS_PLAIN(virtual_line_length)) {
+        return rope_wrap_point_char(text, virtual_line_length, point, col);
     }
 
-    int64_t char_pos = line_rope_char_number_at_line(editor_buffer.current_screen->lines, current_line);
-    int64_t additional_virtual_newlines_needed = line - virtual_newlines_before_current_line;
+    int64_t additional_virtual_newlines_needed = point->row - point->rows_before_line;
     int64_t additional_cols_needed = additional_virtual_newlines_needed * virtual_line_length;
 
-    int64_t final_char_pos = char_pos + additional_cols_needed + col;
-
-    int64_t char_pos_at_start_of_current_line = line_rope_char_number_at_line(editor_buffer.current_screen->lines, current_line);
+    int64_t final_char_pos = point->line_start + additional_cols_needed + col;
 
     // make sure it doesn't go past the end of the current line
-    int64_t end_of_current_line = char_pos_at_start_of_current_line + current_line_length;
+    int64_t end_of_current_line = point->line_start + point->line_length;
     if (final_char_pos > end_of_current_line) {
         final_char_pos = end_of_current_line;
     }
@@ -941,32 +869,47 @@ editor_buffer_character_position_for_virtual_point(struct editor_buffer_t editor
 int64_t
 editor_buffer_get_line_length(struct editor_buffer_t editor_buffer, int64_t line)
 {
-    struct line_rope_t *found_line = line_rope_char_at(editor_buffer.current_screen->lines, line);
-    int64_t found_line_length = found_line == NULL ? -1 : (int64_t) found_line->line_length;
-
-    return found_line_length;
+    return rope_finger_line_length(editor_buffer.finger, editor_buffer.current_screen->text, line);
 }
 
 int64_t
 editor_buffer_get_line_length_virtual(struct editor_buffer_t editor_buffer, int64_t line, int64_t virtual_line_length)
 {
-    ensure_virtual_newline_length(editor_buffer.current_screen->lines, virtual_line_length);
+    ensure_virtual_newline_length(editor_buffer.current_screen->text, virtual_line_length);
 
-    int64_t computed_start_char = editor_buffer_character_position_for_virtual_point(editor_buffer, line, 0, virtual_line_length);
-    int64_t computed_end_char = editor_buffer_character_position_for_virtual_point(editor_buffer, line + 1, 0, virtual_line_length);
+    int64_t rows[2] = {line, line + 1};
+    int64_t row_starts[2];
+    editor_buffer_get_row_starts_virtual(editor_buffer, rows, 2, row_starts, virtual_line_length);
 
-    int64_t length = computed_end_char - computed_start_char;
+    int64_t length = row_starts[1] - row_starts[0];
     if (length < 1) { length = 1; }
 
     return length;
 }
 
+void
+editor_buffer_get_row_starts_virtual(struct editor_buffer_t editor_buffer, const int64_t *rows, int64_t row_count,
+                                     int64_t *out_char_pos, int64_t virtual_line_length)
+{
+    ensure_virtual_newline_length(editor_buffer.current_screen->text, virtual_line_length);
+
+    struct rope_wrap_point_t *points = se_alloc(row_count, sizeof(struct rope_wrap_point_t));
+    rope_wrap_locate_rows(editor_buffer.current_screen->text, virtual_line_length, rows, row_count, points);
+
+    for (int64_t n = 0; n < row_count; n++) {
+        out_char_pos[n] = editor_buffer_char_pos_for_wrap_point(editor_buffer.current_screen->text, &points[n], 0,
+                                                                virtual_line_length);
+    }
+
+    se_free(points);
+}
+
 int64_t
 editor_buffer_get_line_count_virtual(struct editor_buffer_t editor_buffer, int64_t virtual_line_length)
 {
-    ensure_virtual_newline_length(editor_buffer.current_screen->lines, virtual_line_length);
+    ensure_virtual_newline_length(editor_buffer.current_screen->text, virtual_line_length);
 
-    return editor_buffer.current_screen->lines->total_virtual_newline_count;
+    return rope_wrap_row_count(editor_buffer.current_screen->text, virtual_line_length);
 }
 
 int64_t
@@ -979,90 +922,7 @@ int64_t
 editor_buffer_get_char_number_at_line(struct editor_buffer_t editor_buffer, int64_t i)
 {
     struct editor_screen_t screen = editor_buffer_get_current_screen(editor_buffer);
-    return line_rope_char_number_at_line(screen.lines, i);
-}
-
-//int64_t
-//editor_buffer_add_char_incremental(struct rope_t *rn, int64_t start, int64_t end, struct buf_t *buf)
-//{
-//    if (rn == NULL) { return 0; }
-//
-//    if (rn->is_leaf) {
-//        if (rn->char_weight - 1 < start) {
-//            return 0;
-//        }
-//
-//        int64_t byte_offset = 0;
-//
-//        for (int64_t j = 0; j < start; j++) {
-//            byte_offset += bytes_in_codepoint_utf8(*(rn->str_buf->bytes + byte_offset));
-//        }
-//
-//        // write as many chars as we can
-//        int64_t j = start;
-//        while (j < end && byte_offset < rn->str_buf->length) {
-//            int64_t char_size = bytes_in_codepoint_utf8(*(rn->str_buf->bytes + byte_offset));
-//            buf_write_bytes(buf, rn->str_buf->bytes + byte_offset, char_size);
-//            byte_offset += char_size;
-//            j += 1;
-//        }
-//
-//        // return how many chars we wrote
-//        return j - start;
-//    }
-//
-//    if (rn->char_weight - 1 < start) {
-//        return editor_buffer_add_char_incremental(rn->right, start - rn->char_weight, end - rn->char_weight, buf);
-//    } else {
-//        if (rn->left != NULL) {
-//            int64_t added_from_left = editor_buffer_add_char_incremental(rn->left, start, end, buf);
-//            if (rn->right != NULL && start + added_from_left < end) {
-//                int64_t added_from_right = editor_buffer_add_char_incremental(rn->right, start + added_from_left - rn->char_weight, end - rn->char_weight, buf);
-//                return added_from_left + added_from_right;
-//            }
-//            return added_from_left;
-//        }
-//        return 0;
-//    }
-//}
-
-int64_t
-editor_buffer_add_bytes_incremental(struct rope_t *rn, int64_t start, int64_t end, struct buf_t *buf)
-{
-    if (rn == NULL) { return 0; }
-
-    if (rn->is_leaf) {
-        if (rn->byte_weight - 1 < start) {
-            return 0;
-        }
-
-        int64_t possible_bytes = rn->byte_weight - start;
-        int64_t desired_bytes = end - start;
-        int64_t actual_bytes = possible_bytes;
-        if (actual_bytes > desired_bytes) {
-            actual_bytes = desired_bytes;
-        }
-
-        // write to the buffer
-        buf_write_bytes(buf, rn->str_buf->bytes + start, actual_bytes);
-
-        // return how many chars we wrote
-        return actual_bytes;
-    }
-
-    if (rn->byte_weight - 1 < start) {
-        return editor_buffer_add_bytes_incremental(rn->right, start - rn->byte_weight, end - rn->byte_weight, buf);
-    } else {
-        if (rn->left != NULL) {
-            int64_t added_from_left = editor_buffer_add_bytes_incremental(rn->left, start, end, buf);
-            if (rn->right != NULL && start + added_from_left < end) {
-                int64_t added_from_right = editor_buffer_add_bytes_incremental(rn->right, start + added_from_left - rn->byte_weight, end - rn->byte_weight, buf);
-                return added_from_left + added_from_right;
-            }
-            return added_from_left;
-        }
-        return 0;
-    }
+    return rope_finger_char_number_at_line(editor_buffer.finger, screen.text, i);
 }
 
 struct buf_t *
@@ -1075,15 +935,39 @@ editor_buffer_get_text_between_characters(struct editor_buffer_t editor_buffer,
     if (real_end <= start) { return buf_init(0); }
 
     struct rope_t *rn = editor_buffer.current_screen->text;
-    struct buf_t *buf = buf_init(end - start + 1);
 
-    int64_t start_byte = byte_for_char_at(editor_buffer.current_screen->text, start);
-    int64_t end_byte = byte_for_char_at(editor_buffer.current_screen->text, end);
-    editor_buffer_add_bytes_incremental(rn, start_byte, end_byte, buf);
+    int64_t start_byte = byte_for_char_at(rn, start);
+    int64_t end_byte = byte_for_char_at(rn, end);
+
+    struct buf_t *buf = buf_init(end_byte - start_byte + 1);
+
+    struct rope_iter_t iter;
+    rope_iter_init_at_byte(&iter, rn, start_byte);
+
+    int64_t remaining = end_byte - start_byte;
+    while (remaining > 0) {
+        const char *bytes;
+        int64_t length;
+        rope_iter_chunk(&iter, &bytes, &length);
+
+        if (length > remaining) { length = remaining; }
+        buf_write_bytes(buf, bytes, length);
+        remaining -= length;
+
+        if (!rope_iter_next_chunk(&iter)) { break; }
+    }
 
     return buf;
 }
 
+struct rope_t *
+editor_buffer_get_rope_between_characters(struct editor_buffer_t editor_buffer, int64_t start, int64_t end)
+{
+    editor_buffer_use_node_pools(editor_buffer);
+
+    return rope_slice(editor_buffer.current_screen->text, start, end);
+}
+
 struct buf_t *
 editor_buffer_get_text_between_points(struct editor_buffer_t editor_buffer,
                                       int64_t start_line,
@@ -1091,7 +975,8 @@ editor_buffer_get_text_between_points(struct editor_buffer_t editor_buffer,
                                       int64_t end_line,
                                       int64_t end_col)
 {
-    int64_t start_line_char_number = line_rope_char_number_at_line(editor_buffer.current_screen->lines, start_line);
+    int64_t start_line_char_number = rope_finger_char_number_at_line(editor_buffer.finger,
+                                                                     editor_buffer.current_screen->text, start_line);
     if (start_line_char_number < 0) { start_line_char_number = 0; }
 
     int64_t end_line_char_number;
@@ -1103,7 +988,8 @@ editor_buffer_get_text_between_points(struct editor_buffer_t editor_buffer,
     if (end_line >= total_lines) {
         end_line_char_number = rope_total_char_length(editor_buffer.current_screen->text);
     } else {
-        end_line_char_number = line_rope_char_number_at_line(editor_buffer.current_screen->lines, end_line);
+        end_line_char_number = rope_finger_char_number_at_line(editor_buffer.finger, editor_buffer.current_screen->text,
+                                                               end_line);
     }
 
     return editor_buffer_get_text_between_characters(editor_buffer,
@@ -1111,13 +997,25 @@ editor_buffer_get_text_between_points(struct editor_buffer_t editor_buffer,
                                                      end_line_char_number + end_col);
 }
 
+int64_t
+editor_buffer_get_lines(struct editor_buffer_t editor_buffer, int64_t start_row, int64_t count, int8_t virtual,
+                        int64_t virtual_line_length, struct rope_rows_t *out)
+{
+    if (!virtual) {
+        return rope_get_rows(editor_buffer.current_screen->text, 0, start_row, count, out);
+    }
+
+    ensure_virtual_newline_length(editor_buffer.current_screen->text, virtual_line_length);
+    return rope_get_rows(editor_buffer.current_screen->text, virtual_line_length, start_row, count, out);
+}
+
 struct buf_t *
 editor_buffer_get_text_between_points_virtual(struct editor_buffer_t editor_buffer,
                                               int64_t start_line, int64_t start_col,
                                               int64_t end_line, int64_t end_col,
                                               int64_t virtual_line_length)
 {
-    ensure_virtual_newline_length(editor_buffer.current_screen->lines, virtual_line_length);
+    ensure_virtual_newline_length(editor_buffer.current_screen->text, virtual_line_length);
 
     int64_t computed_start_char = editor_buffer_character_position_for_virtual_point(editor_buffer,
                                                                                      start_line,
@@ -1128,12 +1026,14 @@ editor_buffer_get_text_between_points_virtual(struct editor_buffer_t editor_buff
                                                                                    end_col,
                                                                                    virtual_line_length);
 
-    const char *computed_start = rope_char_at(editor_buffer.current_screen->text, computed_start_char);
+    const char *computed_start = rope_finger_char_at(editor_buffer.finger, editor_buffer.current_screen->text,
+                                                         computed_start_char);
     if (computed_start != NULL && *computed_start == '\n') {
         computed_start_char += 1;
     }
 
-    const char *one_before_computed_end = rope_char_at(editor_buffer.current_screen->text, computed_end_char - 1);
+    const char *one_before_computed_end = rope_finger_char_at(editor_buffer.finger, editor_buffer.current_screen->text,
+                                                                  computed_end_char - 1);
     if (one_before_computed_end != NULL && *one_before_computed_end == '\n') {
         computed_end_char -= 1;
     }
@@ -1168,13 +1068,15 @@ editor_buffer_get_virtual_cursor_row_for_point(struct editor_buffer_t editor_buf
                                                int64_t col,
                                               int64_t virtual_line_length)
 {
-    ensure_virtual_newline_length(editor_buffer.current_screen->lines, virtual_line_length);
+    ensure_virtual_newline_length(editor_buffer.current_screen->text, virtual_line_length);
 
-    int64_t virtual_newlines_before_current_line;
-    if (row > 0) {
-        virtual_newlines_before_current_line = virtual_newline_total(editor_buffer.current_screen->lines, row - 1);
-    } else {
-        virtual_newlines_before_current_line = 0;
+    int64_t virtual_newlines_before_current_line = rope_wrap_rows_before_line(editor_buffer.current_screen->text,
+                                                                              virtual_line_length,
+                                                                              row);
+
+    if (!ROPE_WRAP_IS_PLAIN(virtual_line_length)) {
+        return virtual_newlines_before_current_line
+               + rope_wrap_row_for_col(editor_buffer.current_screen->text, virtual_line_length, row, col);
     }
 
     int64_t extra_from_cols;
@@ -1193,7 +1095,7 @@ editor_buffer_get_virtual_cursor_row_for_point(struct editor_buffer_t editor_buf
 int64_t
 editor_buffer_get_cursor_row_virtual(struct editor_buffer_t editor_buffer, int64_t cursor_idx, int64_t virtual_line_length)
 {
-    ensure_virtual_newline_length(editor_buffer.current_screen->lines, virtual_line_length);
+    ensure_virtual_newline_length(editor_buffer.current_screen->text, virtual_line_length);
 
     struct cursor_info_t *cursor_info = (struct cursor_info_t *) vector_at(editor_buffer.current_screen->cursor_infos, cursor_idx);
     return editor_buffer_get_virtual_cursor_row_for_point(editor_buffer,
@@ -1208,7 +1110,11 @@ int64_t editor_buffer_get_virtual_cursor_col_for_point(struct editor_buffer_t ed
                                                        int64_t col,
                                                       int64_t virtual_line_length)
 {
-    ensure_virtual_newline_length(editor_buffer.current_screen->lines, virtual_line_length);
+    ensure_virtual_newline_length(editor_buffer.current_screen->text, virtual_line_length);
+
+    if (!ROPE_WRAP_IS_PLAIN(virtual_line_length)) {
+        return rope_wrap_display_col(editor_buffer.current_screen->text, virtual_line_length, row, col);
+    }
 
     int64_t current_line_length = editor_buffer_get_line_length(editor_buffer, row);
     if (col != 0 && col % current_line_length == 0 && col % virtual_line_length == 0) {
@@ -1221,7 +1127,7 @@ int64_t editor_buffer_get_virtual_cursor_col_for_point(struct editor_buffer_t ed
 int64_t
 editor_buffer_get_cursor_col_virtual(struct editor_buffer_t editor_buffer, int64_t cursor_idx, int64_t virtual_line_length)
 {
-    ensure_virtual_newline_length(editor_buffer.current_screen->lines, virtual_line_length);
+    ensure_virtual_newline_length(editor_buffer.current_screen->text, virtual_line_length);
 
     struct cursor_info_t *cursor_info = (struct cursor_info_t *) vector_at(editor_buffer.current_screen->cursor_infos, cursor_idx);
     return editor_buffer_get_virtual_cursor_col_for_point(editor_buffer,
@@ -1235,7 +1141,7 @@ editor_buffer_set_cursor_point_virtual_for_cursor_index(struct editor_buffer_t e
 {
     struct cursor_info_t *cursor_info = (struct cursor_info_t *) vector_at(editor_buffer.current_screen->cursor_infos, cursor_idx);
 
-    ensure_virtual_newline_length(editor_buffer.current_screen->lines, virtual_line_length);
+    ensure_virtual_newline_length(editor_buffer.current_screen->text, virtual_line_length);
 
     int64_t char_pos = editor_buffer_character_position_for_virtual_point(editor_buffer, row, col, virtual_line_length);
     int64_t total_length = rope_total_char_length(editor_buffer.current_screen->text);
@@ -1308,7 +1214,7 @@ editor_buffer_set_cursor_pos_for_cursor_index(struct editor_buffer_t editor_buff
         cursor_info->char_pos = total_length;
     }
 
-    editor_screen_set_line_and_col_for_char_pos(cursor_info, editor_buffer.current_screen->text);
+    editor_screen_set_line_and_col_for_char_pos(cursor_info, editor_buffer.current_screen->text, editor_buffer.finger);
 }
 
 void
@@ -1472,7 +1378,7 @@ editor_buffer_add_cursor_at_point(struct editor_buffer_t editor_buffer, int64_t
 void
 editor_buffer_add_cursor_at_point_virtual(struct editor_buffer_t editor_buffer, int64_t row, int64_t col, int64_t virtual_line_length)
 {
-    ensure_virtual_newline_length(editor_buffer.current_screen->lines, virtual_line_length);
+    ensure_virtual_newline_length(editor_buffer.current_screen->text, virtual_line_length);
 
     int64_t char_pos = editor_buffer_character_position_for_virtual_point(editor_buffer, row, col, virtual_line_length);
     int64_t total_length = rope_total_char_length(editor_buffer.current_screen->text);
@@ -1480,9 +1386,10 @@ editor_buffer_add_cursor_at_point_virtual(struct editor_buffer_t editor_buffer,
         char_pos = total_length;
     }
 
-    int64_t logical_x = rope_get_line_number_for_char_pos(editor_buffer.current_screen->text, char_pos);
+    int64_t logical_x = rope_finger_line_for_char(editor_buffer.finger, editor_buffer.current_screen->text, char_pos);
 
-    int64_t row_start = rope_char_number_at_line(editor_buffer.current_screen->text, logical_x);
+    int64_t row_start = rope_finger_char_number_at_line(editor_buffer.finger, editor_buffer.current_screen->text,
+                                                        logical_x);
     int64_t logical_y = char_pos - row_start;
 
     editor_buffer_add_cursor_at_point(editor_buffer, logical_x, logical_y);
@@ -1526,7 +1433,7 @@ editor_buffer_set_cursor_pos_relative_for_cursor_index(struct editor_buffer_t ed
             cursor_info->char_pos = total_length;
         }
 
-        editor_screen_set_line_and_col_for_char_pos(cursor_info, editor_buffer.current_screen->text);
+        editor_screen_set_line_and_col_for_char_pos(cursor_info, editor_buffer.current_screen->text, editor_buffer.finger);
 }
 
 int64_t
@@ -1534,7 +1441,7 @@ editor_buffer_get_cursor_selection_start_row_virtual(struct editor_buffer_t edit
 {
     struct cursor_info_t *cursor_info = (struct cursor_info_t *) vector_at(editor_buffer.current_screen->cursor_infos, cursor_idx);
 
-    ensure_virtual_newline_length(editor_buffer.current_screen->lines, virtual_line_length);
+    ensure_virtual_newline_length(editor_buffer.current_screen->text, virtual_line_length);
 
     return editor_buffer_get_virtual_cursor_row_for_point(editor_buffer,
                                                           cursor_info->selection_row,
@@ -1547,7 +1454,7 @@ editor_buffer_get_cursor_selection_start_col_virtual(struct editor_buffer_t edit
 {
     struct cursor_info_t *cursor_info = (struct cursor_info_t *) vector_at(editor_buffer.current_screen->cursor_infos, cursor_idx);
 
-    ensure_virtual_newline_length(editor_buffer.current_screen->lines, virtual_line_length);
+    ensure_virtual_newline_length(editor_buffer.current_screen->text, virtual_line_length);
 
     return editor_buffer_get_virtual_cursor_col_for_point(editor_buffer,
                                                           cursor_info->selection_row,
@@ -1623,13 +1530,22 @@ editor_buffer_free_buf(struct buf_t *buf)
     buf_free(buf);
 }
 
+// finger can be NULL when text isn't the buffer's current text
 void
-editor_screen_set_line_and_col_for_char_pos(struct cursor_info_t *cursor_info, struct rope_t *text)
+editor_screen_set_line_and_col_for_char_pos(struct cursor_info_t *cursor_info, struct rope_t *text,
+                                            struct rope_finger_t *finger)
 {
-    int64_t row = rope_get_line_number_for_char_pos(text, cursor_info->char_pos);
+    struct rope_finger_t local_finger;
+    if (finger == NULL) {
+        rope_finger_reset(&local_finger);
+        finger = &local_finger;
+    }
+
+    int64_t row = rope_finger_line_for_char(finger, text, cursor_info->char_pos);
     cursor_info->row = row;
 
-    int64_t row_start = rope_char_number_at_line(text, row);
+    // the line's start is usually in the same leaf, so this doesn't go back to the root
+    int64_t row_start = rope_finger_char_number_at_line(finger, text, row);
     int64_t col = cursor_info->char_pos - row_start;
     cursor_info->col = col;
 }
@@ -1641,7 +1557,7 @@ kmp_prefix(const char *W, int64_t *T)
     int64_t cnd = 0;
     T[0] = -1;
 
-    int64_t len_W = unicode_strlen(W);
+    int64_t len_W = (int64_t) strlen(W);
 
     while (pos < len_W) {
         if (W[pos] == W[cnd]) {
@@ -1680,11 +1596,16 @@ kmp_search(struct editor_buffer_t editor_buffer, const char *W, int64_t start_ch
     int64_t T[len_W + 1];
     kmp_prefix(W, T);
 
+    // m + i only ever stays put or moves forward by one, so a single iterator walks S
+    struct rope_iter_t iter;
+    rope_iter_init_at_byte(&iter, editor_buffer.current_screen->text, m);
+
     while (m + i < len_S) {
-        char byte_at = rope_byte_at(editor_buffer.current_screen->text, m + i);
+        char byte_at = rope_iter_byte(&iter);
 
         if (byte_at == W[i]) {
             i += 1;
+            rope_iter_next_byte(&iter);
             if (i == len_W) {
                 // occurrence found!
                 return m;
@@ -1695,6 +1616,7 @@ kmp_search(struct editor_buffer_t editor_buffer, const char *W, int64_t start_ch
         } else {
             m = m + i + 1;
             i = 0;
+            rope_iter_next_byte(&iter);
         }
     }
 
@@ -1725,24 +1647,30 @@ kmp_search_backward(struct editor_buffer_t editor_buffer, const char *W, int64_t
     int64_t T[len_W + 1];
     kmp_prefix(WR, T);
 
+    // same as going forward, m - i only ever stays put or moves back by one
+    struct rope_iter_t iter;
+    rope_iter_init_at_byte(&iter, editor_buffer.current_screen->text, m);
+
     int64_t byte_at;
 
     while (m - i >= 0) {
-        byte_at = rope_byte_at(editor_buffer.current_screen->text, m - i);
+        byte_at = rope_iter_byte(&iter);
 
         if (byte_at == WR[i]) {
             i += 1;
+            rope_iter_prev_byte(&iter);
             if (i == len_W) {
                 // occurrence found!
                 return (int64_t) (m - len_W + 1);
             }
         } else {
             if (T[i] > -1) {
-                m = m - i - T[i];
+                m = m - i + T[i];
                 i = T[i];
             } else {
                 m = m - i - 1;
                 i = 0;
+                if (!rope_iter_prev_byte(&iter)) { break; }
             }
         }
     }
@@ -1914,14 +1842,17 @@ editor_buffer_set_cursor_point_to_start_of_next_word(struct editor_buffer_t edit
         int64_t max_char = editor_buffer_get_char_count(editor_buffer);
 
         int8_t skipping_word_breaking_chars = 0;
-        const char *start_char = rope_char_at(editor_buffer.current_screen->text, current_char);
+        struct rope_iter_t iter;
+        rope_iter_init_at_char(&iter, editor_buffer.current_screen->text, current_char);
+
+        const char *start_char = rope_iter_char(&iter);
         if (current_char < max_char && str_contains(word_breaking_chars, *start_char)) {
             skipping_word_breaking_chars = 1;
         }
 
         int8_t found_start = 0;
         while (current_char < max_char) {
-            const char *char_at = rope_char_at(editor_buffer.current_screen->text, current_char);
+            const char *char_at = rope_iter_char(&iter);
 
             if (char_at != NULL) {
                 if (skipping_word_breaking_chars) {
@@ -1930,7 +1861,8 @@ editor_buffer_set_cursor_point_to_start_of_next_word(struct editor_buffer_t edit
                            && (str_contains(word_breaking_chars, *char_at))
                            && current_char < max_char) {
                         current_char += 1;
-                        char_at = rope_char_at(editor_buffer.current_screen->text, current_char);
+                        rope_iter_next_char(&iter);
+                        char_at = rope_iter_char(&iter);
                     }
                 } else {
                     // skip non-spaces which are also non-word-breaking-chars
@@ -1938,7 +1870,8 @@ editor_buffer_set_cursor_point_to_start_of_next_word(struct editor_buffer_t edit
                            && (!str_contains(word_breaking_chars, *char_at) && !str_contains(" \n\t", *char_at))
                            && current_char < max_char) {
                         current_char += 1;
-                        char_at = rope_char_at(editor_buffer.current_screen->text, current_char);
+                        rope_iter_next_char(&iter);
+                        char_at = rope_iter_char(&iter);
                     }
                 }
 
@@ -1947,7 +1880,8 @@ editor_buffer_set_cursor_point_to_start_of_next_word(struct editor_buffer_t edit
                        && (str_contains(" \n\t", *char_at))
                        && current_char < max_char) {
                     current_char += 1;
-                    char_at = rope_char_at(editor_buffer.current_screen->text, current_char);
+                    rope_iter_next_char(&iter);
+                    char_at = rope_iter_char(&iter);
                 }
 
                 editor_buffer_set_cursor_pos_for_cursor_index(editor_buffer, i, current_char);
@@ -1956,6 +1890,7 @@ editor_buffer_set_cursor_point_to_start_of_next_word(struct editor_buffer_t edit
             }
 
             current_char += 1;
+            rope_iter_next_char(&iter);
         }
 
         if (!found_start) {
@@ -1972,25 +1907,29 @@ editor_buffer_set_cursor_point_to_end_of_current_word(struct editor_buffer_t edi
         int64_t current_char = cursor.char_pos;
         int64_t max_char = editor_buffer_get_char_count(editor_buffer);
 
-        const char *start_char = rope_char_at(editor_buffer.current_screen->text, current_char);
+        struct rope_iter_t iter;
+        rope_iter_init_at_char(&iter, editor_buffer.current_screen->text, current_char);
+
+        const char *start_char = rope_iter_char(&iter);
 
         // skip spaces
         while (start_char != NULL
                && (str_contains(" \n\t", *start_char))
                && current_char < max_char) {
             current_char += 1;
-            start_char = rope_char_at(editor_buffer.current_screen->text, current_char);
+            rope_iter_next_char(&iter);
+            start_char = rope_iter_char(&iter);
         }
 
         int8_t skipping_word_breaking_chars = 0;
-        start_char = rope_char_at(editor_buffer.current_screen->text, current_char);
+        start_char = rope_iter_char(&iter);
         if (current_char < max_char && str_contains(word_breaking_chars, *start_char)) {
             skipping_word_breaking_chars = 1;
         }
 
         int8_t found_start = 0;
         while (current_char < max_char) {
-            const char *char_at = rope_char_at(editor_buffer.current_screen->text, current_char);
+            const char *char_at = rope_iter_char(&iter);
 
             if (char_at != NULL) {
                 if (skipping_word_breaking_chars) {
@@ -1999,7 +1938,8 @@ editor_buffer_set_cursor_point_to_end_of_current_word(struct editor_buffer_t edi
                            && (str_contains(word_breaking_chars, *char_at))
                            && current_char < max_char) {
                         current_char += 1;
-                        char_at = rope_char_at(editor_buffer.current_screen->text, current_char);
+                        rope_iter_next_char(&iter);
+                        char_at = rope_iter_char(&iter);
                     }
                 } else {
                     // skip non-spaces which are also non-word-breaking-chars
@@ -2007,7 +1947,8 @@ editor_buffer_set_cursor_point_to_end_of_current_word(struct editor_buffer_t edi
                            && (!str_contains(word_breaking_chars, *char_at) && !str_contains(" \n\t", *char_at))
                            && current_char < max_char) {
                         current_char += 1;
-                        char_at = rope_char_at(editor_buffer.current_screen->text, current_char);
+                        rope_iter_next_char(&iter);
+                        char_at = rope_iter_char(&iter);
                     }
                 }
 
@@ -2017,6 +1958,7 @@ editor_buffer_set_cursor_point_to_end_of_current_word(struct editor_buffer_t edi
             }
 
             current_char += 1;
+            rope_iter_next_char(&iter);
         }
 
         if (!found_start) {
@@ -2069,19 +2011,25 @@ editor_buffer_set_cursor_point_to_start_of_previous_word(struct editor_buffer_t
         struct cursor_info_t cursor = *((struct cursor_info_t *) vector_at(editor_buffer.current_screen->cursor_infos, i));
         int64_t current_char = cursor.char_pos - 1;
 
-        const char *char_at = rope_char_at(editor_buffer.current_screen->text, current_char);
+        struct rope_iter_t iter;
+        rope_iter_init_at_char(&iter, editor_buffer.current_screen->text, current_char);
+
+        const char *char_at = rope_iter_char(&iter);
+        if (char_at == NULL) { continue; }
 
         // skip all spaces
-        while (str_contains(" \n\t", *char_at)) {
+        while (str_contains(" \n\t", *char_at) && current_char > 0) {
             current_char -= 1;
-            char_at = rope_char_at(editor_buffer.current_screen->text, current_char);
+            rope_iter_prev_char(&iter);
+            char_at = rope_iter_char(&iter);
         }
 
         if (str_contains(word_breaking_chars, *char_at)) {
             // if we're at a word_breaking_char, then go until we hit a non-word-breaking-char
             while (str_contains(word_breaking_chars, *char_at) && current_char > 0) {
                 current_char -= 1;
-                char_at = rope_char_at(editor_buffer.current_screen->text, current_char);
+                rope_iter_prev_char(&iter);
+                char_at = rope_iter_char(&iter);
             }
 
             if (!str_contains(word_breaking_chars, *char_at)) {
@@ -2092,7 +2040,8 @@ editor_buffer_set_cursor_point_to_start_of_previous_word(struct editor_buffer_t
             while ((!str_contains(word_breaking_chars, *char_at) && !str_contains(" \n\t", *char_at))
                    && current_char > 0) {
                 current_char -= 1;
-                char_at = rope_char_at(editor_buffer.current_screen->text, current_char);
+                rope_iter_prev_char(&iter);
+                char_at = rope_iter_char(&iter);
             }
 
             // !(A & B) <==> !A | !B
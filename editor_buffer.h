@@ -9,6 +9,10 @@ editor_buffer_create(uint32_t virtual_line_length);
 void
 editor_buffer_destroy(struct editor_buffer_t editor_buffer);
 
+// points the global node pools at this buffer's, anything that builds ropes for it calls this first
+void
+editor_buffer_use_node_pools(struct editor_buffer_t editor_buffer);
+
 void
 editor_buffer_open_file(struct editor_buffer_t editor_buffer, uint32_t virtual_line_length, const char *file_path);
 
@@ -21,9 +25,18 @@ editor_buffer_save_file_as(struct editor_buffer_t editor_buffer, const char *fil
 int8_t
 editor_buffer_has_file_path(struct editor_buffer_t editor_buffer);
 
+// whether the text is any different from when the file was last opened or saved
+int8_t
+editor_buffer_is_modified(struct editor_buffer_t editor_buffer);
+
 void
 editor_buffer_insert(struct editor_buffer_t editor_buffer, const char *text);
 
+// pastes rope, e.g. one from editor_buffer_get_rope_between_characters, at every cursor without copying its text.
+// rope is left as it was
+void
+editor_buffer_insert_rope(struct editor_buffer_t editor_buffer, struct rope_t *rope);
+
 void
 editor_buffer_insert_at_point(struct editor_buffer_t editor_buffer, const char *text,
                               int64_t row, int64_t col,
@@ -43,12 +56,27 @@ editor_buffer_undo(struct editor_buffer_t editor_buffer, int64_t undo_idx);
 void
 editor_buffer_global_undo(struct editor_buffer_t editor_buffer, int64_t undo_idx);
 
+// folds together the small leaves many small edits leave behind, a bounded amount at a time (at most leaf_budget
+// leaves) for calling while the editor is idle. the text doesn't change and no undo step is added. returns 1 while
+// the pass over the current text has further to go, and 0 once it's done, until the next edit
+int8_t
+editor_buffer_compact(struct editor_buffer_t editor_buffer, int64_t leaf_budget);
+
 int64_t
 editor_buffer_get_line_length(struct editor_buffer_t editor_buffer, int64_t line);
 
+// the *_virtual functions go by rows of text wrapped every virtual_line_length chars, or at word boundaries when
+// it has ROPE_WRAP_WORDS or'd in. with ROPE_WRAP_DISPLAY or'd in, it and the virtual cols are display columns,
+// so tabs and wide chars take up as much of a row as they do on screen. line lengths stay in chars
 int64_t
 editor_buffer_get_line_length_virtual(struct editor_buffer_t editor_buffer, int64_t line, int64_t virtual_line_length);
 
+// out_char_pos[n] gets where virtual row rows[n] starts, for row_count rows in order (like the ones on screen),
+// all found together rather than one at a time
+void
+editor_buffer_get_row_starts_virtual(struct editor_buffer_t editor_buffer, const int64_t *rows, int64_t row_count,
+                                     int64_t *out_char_pos, int64_t virtual_line_length);
+
 int64_t
 editor_buffer_get_line_count(struct editor_buffer_t editor_buffer);
 
@@ -64,9 +92,22 @@ editor_buffer_get_char_number_at_line(struct editor_buffer_t editor_buffer, int6
 struct buf_t *
 editor_buffer_get_text_between_characters(struct editor_buffer_t editor_buffer, int64_t start, int64_t end);
 
+// the same text as editor_buffer_get_text_between_characters, as a rope sharing its leaves with the buffer's.
+// the caller frees it with rope_free (or holds it with rope_inc_rc/rope_dec_rc), and since it's made of this
+// buffer's nodes it can't outlive the buffer. pasting it elsewhere with editor_buffer_insert_rope is fine
+struct rope_t *
+editor_buffer_get_rope_between_characters(struct editor_buffer_t editor_buffer, int64_t start, int64_t end);
+
 struct buf_t *
 editor_buffer_get_text_between_points(struct editor_buffer_t editor_buffer, int64_t start_line, int64_t start_col, int64_t end_line, int64_t end_col);
 
+// the count rows from start_row on (virtual rows, or lines when virtual is 0), found together and given as fragments
+// of the current text rather than copies of it (see rope_get_rows). out's arrays belong to the caller, and nothing
+// is allocated. the fragments stay good until the text changes, or for as long as a reference to it is held
+int64_t
+editor_buffer_get_lines(struct editor_buffer_t editor_buffer, int64_t start_row, int64_t count, int8_t virtual,
+                        int64_t virtual_line_length, struct rope_rows_t *out);
+
 struct buf_t *
 editor_buffer_get_text_between_points_virtual(struct editor_buffer_t editor_buffer, int64_t start_line,
                                               int64_t start_col, int64_t end_line, int64_t end_col,
@@ -207,7 +248,7 @@ void
 editor_buffer_free_buf(struct buf_t *buf);
 
 void
-ensure_virtual_newline_length(struct line_rope_t *rn, int64_t virtual_line_length);
+ensure_virtual_newline_length(struct rope_t *rn, int64_t virtual_line_length);
 
 int64_t
 editor_buffer_search_forward(struct editor_buffer_t editor_buffer, const char *search, int64_t start_char);
@@ -1,62 +1,236 @@
 #ifndef SE_ALL_TYPES_H
 #define SE_ALL_TYPES_H
 
+#include <stddef.h>
+
 #include "vector.h"
 
 #define UNDO_BUFFER_SIZE 1000
 #define GLOBAL_UNDO_BUFFER_SIZE 10000
 
+// b+tree fanout. every leaf sits at the same depth, so a descent touches at most log_16(leaves) parents
+#define ROPE_MAX_CHILDREN 16
+
+// every parent except the root keeps at least this many children, which bounds the height at log_8(leaves) + 1
+#define ROPE_MIN_CHILDREN 8
+
+// how many wrap widths a node keeps row counts for at once, so e.g. two views of a buffer at different widths
+// don't keep recounting over each other
+#define ROPE_WRAP_CACHE_SIZE 2
+
+// or'd into a wrap width to wrap at word boundaries (see rope_wrap_walk) rather than every wrap width chars
+#define ROPE_WRAP_WORDS (1 << 30)
+
+// or'd into a wrap width to lay rows out in display columns (see unicode_display_width) rather than chars. tabs go
+// on to the next tab stop, every ROPE_WRAP_TAB_WIDTH(n) columns when that's or'd in as well (n up to 31), or every 8
+#define ROPE_WRAP_DISPLAY (1 << 29)
+#define ROPE_WRAP_TAB_WIDTH(tab_width) ((tab_width) << 24)
+
+// the width itself, without any of the above
+#define ROPE_WRAP_WIDTH_MASK ((1 << 24) - 1)
+
+// whether a wrap width wraps every so many chars, which is worked out from line lengths alone
+#define ROPE_WRAP_IS_PLAIN(wrap_width) (((wrap_width) & (ROPE_WRAP_WORDS | ROPE_WRAP_DISPLAY)) == 0)
+
 struct rope_t {
-    int64_t byte_weight;
     int64_t total_byte_weight;
-
-    int64_t char_weight;
     int64_t total_char_weight;
-
-    int64_t line_break_weight;
     int64_t total_line_break_weight;
 
     int8_t is_leaf;
 
+    // leaves are height 0, every child of a parent has height (parent height - 1)
+    int8_t height;
+    int8_t child_count;
+
     int32_t rc;
 
+    // lengths in chars of the lines the node starts and ends partway through (the same line when it has no '\n'),
+    // and of the longest line that's in it even in part. worked out on demand by rope_update_line_summary,
+    // has_line_summary is 0 until then
+    int64_t first_line_length;
+    int64_t last_line_length;
+    int64_t longest_line_length;
+
+    // rows taken up by the lines that start and end inside the node, wrapped every wrap_widths[n] chars, for the
+    // last ROPE_WRAP_CACHE_SIZE widths asked about (most recent first). a width of 0 is an empty slot
+    int64_t wrap_row_counts[ROPE_WRAP_CACHE_SIZE];
+    int32_t wrap_widths[ROPE_WRAP_CACHE_SIZE];
+
+    int8_t has_line_summary;
+
+    // set when some of the node's text is U+FFFDs that took the place of invalid utf-8 (see rope_collect_leaves)
+    int8_t has_replacement_chars;
+
+    // a polynomial hash of the node's bytes (see rope_hash_bytes). worked out on demand by rope_update_hash,
+    // has_hash is 0 until then
+    int8_t has_hash;
+    uint64_t hash;
+
     union {
-        // for parent nodes
+        // for parent nodes.
+        // the *_prefix arrays hold running totals, e.g. char_prefix[k] is the number of chars in children[0..k],
+        // so finding the child for a position is a scan over one contiguous array
         struct {
-            struct rope_t *left;
-            struct rope_t *right;
+            struct rope_t *children[ROPE_MAX_CHILDREN];
+            int64_t byte_prefix[ROPE_MAX_CHILDREN];
+            int64_t char_prefix[ROPE_MAX_CHILDREN];
+            int64_t line_break_prefix[ROPE_MAX_CHILDREN];
         };
         // for leaf nodes
-//        struct {
-//            const char *page_path;
+        struct {
+            // leaves are slices of a shared buffer: this leaf's bytes are the total_byte_weight bytes
+            // starting at str_buf->bytes + str_offset, so splitting a leaf never copies it
             struct buf_t *str_buf;
-//        };
+            int64_t str_offset;
+
+            // set when the leaf is plain ascii, so a char offset is also a byte offset
+            int8_t is_ascii;
+
+            // set while the leaf is in rope_leaf_store, which it has to leave when it's released
+            int8_t in_leaf_store;
+
+            // otherwise, char_checkpoints[k] is the byte offset of char (k + 1) * 256, so finding a char never
+            // walks more than 256 codepoints. NULL when the leaf is ascii or too short to need one
+            int32_t *char_checkpoints;
+
+            // rows taken up by the line that ends at the leaf's first '\n' (or at its end, when it has none), which
+            // can start leaves before it, for each of wrap_widths, along with the length and hash of the line they
+            // were counted for. the leaf can be shared with ropes where that line is different, so they're only
+            // good while those still match (see rope_wrap_rows_for_line). a length of -1 is an empty entry
+            int64_t wrap_line_rows[ROPE_WRAP_CACHE_SIZE];
+            int64_t wrap_line_lengths[ROPE_WRAP_CACHE_SIZE];
+            uint64_t wrap_line_hashes[ROPE_WRAP_CACHE_SIZE];
+
+            // where each of the leaf's '\n's is, built the first time a line lookup lands in the leaf
+            // (see rope_leaf_line_breaks). NULL until then
+            struct rope_line_break_t *line_breaks;
+        };
     };
 };
 
-struct line_rope_t {
-    // how long is this line?
-    uint32_t line_length;
-    uint32_t total_line_length;
-    uint32_t longest_child_line_length;
+struct rope_line_break_t {
+    int32_t byte_offset;
+    int32_t char_offset;
+};
 
-    // every leaf counts for one 'character'
-    uint32_t char_weight;
-    uint32_t total_char_weight;
+// a leaf never touches the parent half of the union, so leaves are allocated at this size rather than
+// sizeof(struct rope_t), which is mostly the children and prefix arrays
+#define ROPE_LEAF_SIZE (offsetof(struct rope_t, line_breaks) + sizeof(struct rope_line_break_t *))
 
-    uint32_t virtual_line_length;
+#define ROPE_NODE_SIZE(is_leaf) ((is_leaf) ? ROPE_LEAF_SIZE : sizeof(struct rope_t))
 
-    uint32_t virtual_newline_count;
-    uint32_t total_virtual_newline_count;
+// besides bytes, chars and line breaks, a rope can keep any number of registered summaries up to date.
+// a summary is value_count int64s per node: worked out from the bytes for a leaf, and folded left to right
+// over the children with combine_fn for a parent. combine_fn has to be associative, and summarizing zero
+// bytes has to give its identity. the values sit right after the node (see rope_summary_values), so every
+// summary has to be registered before the first rope is made
+#define ROPE_MAX_SUMMARY_TYPES 8
 
-    int32_t height;
+typedef void (*rope_summary_leaf_fn_t)(const char *bytes, int64_t byte_length, int64_t *out);
+typedef void (*rope_summary_combine_fn_t)(const int64_t *left, const int64_t *right, int64_t *out);
 
-    int8_t is_leaf;
+// the offset into bytes at which the summary's seek value, counted from the start of bytes, first reaches target
+typedef int64_t (*rope_summary_seek_fn_t)(const char *bytes, int64_t byte_length, int64_t target);
 
-    int32_t rc;
+struct rope_summary_type_t {
+    int64_t value_count;
+    rope_summary_leaf_fn_t leaf_fn;
+    rope_summary_combine_fn_t combine_fn;
+
+    // rope_summary_seek finds a position by values[seek_value], which has to add up across a concat the
+    // way a count does. -1 when the summary can't be sought by
+    int64_t seek_value;
+    rope_summary_seek_fn_t leaf_seek_fn;
 
-    struct line_rope_t *left;
-    struct line_rope_t *right;
+    // filled in by rope_summary_register: where this summary's values start among a node's
+    int64_t value_offset;
+};
+
+// with every parent but the root at least half full, no rope gets anywhere near this deep
+#define ROPE_ITER_MAX_DEPTH 32
+
+// a position in a rope that remembers the path down to its leaf, so stepping to a neighbouring byte, char or line
+// only climbs back up the tree when it crosses into another leaf, and then only as far as the nearest common parent.
+// it holds no references, so it's only good for as long as the rope it was made from
+struct rope_iter_t {
+    // path[d + 1] is path[d]->children[child_index[d]], and path[depth] is the leaf
+    struct rope_t *path[ROPE_ITER_MAX_DEPTH];
+    int8_t child_index[ROPE_ITER_MAX_DEPTH];
+    int8_t depth;
+
+    struct rope_t *leaf;
+    int64_t leaf_byte_start;
+    int64_t leaf_char_start;
+    int64_t leaf_line_break_start;
+
+    // position within the leaf
+    int64_t byte_offset;
+    int64_t char_offset;
+};
+
+struct rope_finger_t {
+    // the rope iter is on, NULL when there isn't one
+    struct rope_t *root;
+    struct rope_iter_t iter;
+};
+
+// where a wrapped row is (see rope_wrap_locate_row). positions and lengths are in chars
+struct rope_wrap_point_t {
+    int64_t row;
+
+    // the line the row is part of, where it starts and its length, not counting its '\n'
+    int64_t line;
+    int64_t line_start;
+    int64_t line_length;
+
+    // rows taken up by every line before it, so row - rows_before_line is the row's place in the line
+    int64_t rows_before_line;
+};
+
+// how far rope_wrap_walk_on has got through a line's rows, so it can carry on from there
+struct rope_wrap_walk_t {
+    // at char i of the line
+    struct rope_iter_t *iter;
+    int64_t i;
+
+    // rows gone through so far, and where in the line the last of them starts
+    int64_t rows;
+    int64_t row_start;
+
+    // columns taken up by that row so far, and just past its last space or tab and the column that's at
+    int64_t col;
+    int64_t break_at;
+    int64_t break_col;
+};
+
+// some of a leaf's bytes, pointed to where they are rather than copied, so they're only there for as long as the
+// leaf is (see rope_get_rows)
+struct rope_fragment_t {
+    struct rope_t *leaf;
+    const char *bytes;
+    int64_t length;
+};
+
+// a row of text, made up of fragments[fragment_start] on for fragment_count fragments of the rope_rows_t it's in.
+// the '\n' at the end of a line isn't part of its last row
+struct rope_row_t {
+    int64_t line;
+    int64_t char_start;
+    int64_t char_length;
+    int64_t fragment_start;
+    int64_t fragment_count;
+};
+
+// rows and fragments point at arrays the caller owns, with room for row_capacity and fragment_capacity of them
+struct rope_rows_t {
+    struct rope_row_t *rows;
+    int64_t row_capacity;
+    int64_t row_count;
+
+    struct rope_fragment_t *fragments;
+    int64_t fragment_capacity;
+    int64_t fragment_count;
 };
 
 struct cursor_info_t {
@@ -73,7 +247,6 @@ struct cursor_info_t {
 struct editor_screen_t {
     struct vector_t *cursor_infos; // vector of 'struct cursor_info_t'
     struct rope_t *text;
-    struct line_rope_t *lines;
 };
 
 struct editor_buffer_t {
@@ -87,12 +260,23 @@ struct editor_buffer_t {
 
     struct editor_screen_t *current_screen;
 
+    // the hash and length of the text as it was when it was last opened or saved, see editor_buffer_is_modified
+    uint64_t *saved_hash;
+    int64_t *saved_byte_length;
+
+    // how far editor_buffer_compact's pass over the text has got, and the text it last left behind
+    int64_t *compact_position;
+    struct rope_t **compact_text;
+
+    // where in current_screen->text the last query was, so the next one nearby starts from there.
+    // reset whenever current_screen changes
+    struct rope_finger_t *finger;
+
     int8_t *save_to_undo;
-};
 
-struct line_helper_t {
-    struct vector_t *lines;
-    int64_t leftover;
+    // every rope node this buffer makes comes from these, so they all go at once when it's destroyed
+    struct node_pool_t *rope_pool;
+    struct node_pool_t *rope_leaf_pool;
 };
 
 #endif //SE_ALL_TYPES_H
@@ -0,0 +1,127 @@
+#include <string.h>
+
+#include "leaf_store.h"
+#include "rope.h"
+#include "util.h"
+
+#define LEAF_STORE_INITIAL_CAPACITY 64
+
+// forward declarations
+void
+leaf_store_grow(struct leaf_store_t *store);
+
+int64_t
+leaf_store_slot_for_leaf(struct leaf_store_t *store, struct rope_t *leaf);
+
+// init
+struct leaf_store_t *
+leaf_store_init()
+{
+    struct leaf_store_t *store = se_alloc(1, sizeof(struct leaf_store_t));
+
+    store->capacity = LEAF_STORE_INITIAL_CAPACITY;
+    store->slots = se_alloc(store->capacity, sizeof(struct rope_t *));
+    store->count = 0;
+
+    return store;
+}
+
+// methods
+struct rope_t *
+leaf_store_find(struct leaf_store_t *store, uint64_t hash, const char *bytes, int64_t byte_length)
+{
+    int64_t mask = store->capacity - 1;
+
+    for (int64_t s = (int64_t) (hash & (uint64_t) mask); store->slots[s] != NULL; s = (s + 1) & mask) {
+        struct rope_t *leaf = store->slots[s];
+
+        // a matching hash is only very likely the same text, so the bytes have the last word
+        if (leaf->hash == hash && leaf->total_byte_weight == byte_length
+            && memcmp(rope_leaf_bytes(leaf), bytes, (size_t) byte_length) == 0) {
+            return leaf;
+        }
+    }
+
+    return NULL;
+}
+
+void
+leaf_store_add(struct leaf_store_t *store, struct rope_t *leaf)
+{
+    SE_ASSERT(leaf->is_leaf && leaf->has_hash);
+
+    if ((store->count + 1) * 4 > store->capacity * 3) {
+        leaf_store_grow(store);
+    }
+
+    int64_t mask = store->capacity - 1;
+
+    int64_t s = (int64_t) (leaf->hash & (uint64_t) mask);
+    while (store->slots[s] != NULL) { s = (s + 1) & mask; }
+
+    store->slots[s] = leaf;
+    store->count += 1;
+}
+
+void
+leaf_store_remove(struct leaf_store_t *store, struct rope_t *leaf)
+{
+    int64_t s = leaf_store_slot_for_leaf(store, leaf);
+    if (s < 0) { return; }
+
+    int64_t mask = store->capacity - 1;
+
+    // shift back every entry after the hole that would otherwise no longer be reachable from its home slot
+    int64_t hole = s;
+    for (int64_t next = (hole + 1) & mask; store->slots[next] != NULL; next = (next + 1) & mask) {
+        int64_t home = (int64_t) (store->slots[next]->hash & (uint64_t) mask);
+
+        int8_t reachable = hole <= next ? (home > hole && home <= next) : (home > hole || home <= next);
+        if (!reachable) {
+            store->slots[hole] = store->slots[next];
+            hole = next;
+        }
+    }
+
+    store->slots[hole] = NULL;
+    store->count -= 1;
+}
+
+void
+leaf_store_grow(struct leaf_store_t *store)
+{
+    struct rope_t **old_slots = store->slots;
+    int64_t old_capacity = store->capacity;
+
+    store->capacity = old_capacity * 2;
+    store->slots = se_alloc(store->capacity, sizeof(struct rope_t *));
+    store->count = 0;
+
+    for (int64_t s = 0; s < old_capacity; s++) {
+        if (old_slots[s] != NULL) { leaf_store_add(store, old_slots[s]); }
+    }
+
+    se_free(old_slots);
+}
+
+int64_t
+leaf_store_slot_for_leaf(struct leaf_store_t *store, struct rope_t *leaf)
+{
+    int64_t mask = store->capacity - 1;
+
+    for (int64_t s = (int64_t) (leaf->hash & (uint64_t) mask); store->slots[s] != NULL; s = (s + 1) & mask) {
+        if (store->slots[s] == leaf) { return s; }
+    }
+
+    return -1;
+}
+
+// free
+void
+leaf_store_free(struct leaf_store_t *store)
+{
+    if (store == NULL) { return; }
+
+    se_free(store->slots);
+    se_free(store);
+}
@@ -0,0 +1,39 @@
+#ifndef SE_LEAF_STORE_H
+#define SE_LEAF_STORE_H
+
+#include <stdint.h>
+
+#include "forward_types.h"
+
+// leaves looked up by their hash and bytes, so text that's already in some rope can share its leaf rather than be
+// stored again. entries don't hold a reference: a leaf takes itself out when it's released (see rope_release_node)
+struct leaf_store_t {
+    // open addressing with linear probing, NULL where there's no entry. capacity is a power of two
+    struct rope_t **slots;
+    int64_t capacity;
+    int64_t count;
+};
+
+// init
+struct leaf_store_t *
+leaf_store_init();
+
+// methods
+// a leaf holding exactly bytes[0..byte_length), whose hash is hash, or NULL
+struct rope_t *
+leaf_store_find(struct leaf_store_t *store, uint64_t hash, const char *bytes, int64_t byte_length);
+
+// the leaf's hash has to be worked out already
+void
+leaf_store_add(struct leaf_store_t *store, struct rope_t *leaf);
+
+// does nothing if the leaf isn't in the store
+void
+leaf_store_remove(struct leaf_store_t *store, struct rope_t *leaf);
+
+// free
+// the leaves themselves are left alone
+void
+leaf_store_free(struct leaf_store_t *store);
+
+#endif //SE_LEAF_STORE_H
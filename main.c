@@ -1,14 +1,35 @@
 
+#include <stdio.h>
 #include <string.h>
 #include "forward_types.h"
 #include "buf.h"
 #include "editor_buffer.h"
 
+#define PRINT_PAGE_LINES 64
+#define PRINT_PAGE_FRAGMENTS 256
+
 void print_buffer(struct editor_buffer_t buffer) {
+    struct rope_row_t rows[PRINT_PAGE_LINES];
+    struct rope_fragment_t fragments[PRINT_PAGE_FRAGMENTS];
+    struct rope_rows_t page = {rows, PRINT_PAGE_LINES, 0, fragments, PRINT_PAGE_FRAGMENTS, 0};
+
     int64_t line_count = editor_buffer_get_line_count(buffer);
-    for (int64_t i = 0; i < line_count; i++) {
-        struct buf_t *line_buf = editor_buffer_get_text_between_points(buffer, i, 0, i + 1, 0);
-        buf_print_fmt("%str", line_buf->bytes);
+    for (int64_t i = 0; i < line_count; i += page.row_count) {
+        if (editor_buffer_get_lines(buffer, i, PRINT_PAGE_LINES, 0, 0, &page) == 0) {
+            // a line in more pieces than there's room for is copied out instead, along with its '\n'
+            struct buf_t *line = editor_buffer_get_text_between_points(buffer, i, 0, i + 1, 0);
+            fwrite(line->bytes, 1, (size_t) line->length, stdout);
+            buf_free(line);
+            i += 1;
+            continue;
+        }
+
+        for (int64_t k = 0; k < page.row_count; k++) {
+            for (int64_t f = rows[k].fragment_start; f < rows[k].fragment_start + rows[k].fragment_count; f++) {
+                fwrite(fragments[f].bytes, 1, (size_t) fragments[f].length, stdout);
+            }
+            if (i + k + 1 < line_count) { fputc('\n', stdout); }
+        }
     }
 }
 
@@ -0,0 +1,170 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "node_pool.h"
+#include "util.h"
+
+// forward declarations
+struct node_slab_t *
+node_pool_add_slab(struct node_pool_t *pool);
+
+struct node_slab_t *
+node_slab_for_node(void *node);
+
+int64_t
+node_slab_index_for_node(struct node_slab_t *slab, void *node);
+
+// init
+struct node_pool_t *
+node_pool_init(int64_t node_size)
+{
+    SE_ASSERT(node_size >= NODE_POOL_MIN_NODE_SIZE);
+
+    struct node_pool_t *pool = se_alloc(1, sizeof(struct node_pool_t));
+
+    // keep every node pointer-aligned
+    pool->node_size = (node_size + 15) / 16 * 16;
+    pool->nodes_per_slab = (NODE_POOL_SLAB_BYTES - (int64_t) sizeof(struct node_slab_t) - 16) / pool->node_size;
+
+    pool->slabs = NULL;
+    pool->free_list = NULL;
+    pool->slab_count = 0;
+    pool->live_count = 0;
+    pool->peak_count = 0;
+
+    return pool;
+}
+
+struct node_slab_t *
+node_pool_add_slab(struct node_pool_t *pool)
+{
+    void *mem = NULL;
+    if (posix_memalign(&mem, NODE_POOL_SLAB_BYTES, NODE_POOL_SLAB_BYTES) != 0) {
+        SE_PANIC("could not allocate node slab");
+        return NULL;
+    }
+
+    struct node_slab_t *slab = mem;
+    memset(slab, 0, sizeof(struct node_slab_t));
+
+    slab->pool = pool;
+    slab->used_count = 0;
+    slab->nodes = (char *) mem + (sizeof(struct node_slab_t) + 15) / 16 * 16;
+
+    slab->next = pool->slabs;
+    pool->slabs = slab;
+    pool->slab_count += 1;
+
+    return slab;
+}
+
+// methods
+void *
+node_pool_alloc(struct node_pool_t *pool)
+{
+    void *node;
+    struct node_slab_t *slab;
+
+    if (pool->free_list != NULL) {
+        node = pool->free_list;
+        pool->free_list = *((void **) node);
+        slab = node_slab_for_node(node);
+    } else {
+        slab = pool->slabs;
+        if (slab == NULL || slab->used_count == pool->nodes_per_slab) {
+            slab = node_pool_add_slab(pool);
+        }
+
+        node = slab->nodes + slab->used_count * pool->node_size;
+        slab->used_count += 1;
+    }
+
+    int64_t index = node_slab_index_for_node(slab, node);
+    slab->live[index / 64] |= (uint64_t) 1 << (index % 64);
+
+    pool->live_count += 1;
+    if (pool->live_count > pool->peak_count) {
+        pool->peak_count = pool->live_count;
+    }
+
+    memset(node, 0, (size_t) pool->node_size);
+    return node;
+}
+
+struct node_slab_t *
+node_slab_for_node(void *node)
+{
+    return (struct node_slab_t *) ((uintptr_t) node & ~((uintptr_t) NODE_POOL_SLAB_BYTES - 1));
+}
+
+int64_t
+node_slab_index_for_node(struct node_slab_t *slab, void *node)
+{
+    return ((char *) node - slab->nodes) / slab->pool->node_size;
+}
+
+struct node_pool_t *
+node_pool_for_node(void *node)
+{
+    return node_slab_for_node(node)->pool;
+}
+
+int64_t
+node_pool_live_count(struct node_pool_t *pool)
+{
+    return pool->live_count;
+}
+
+int64_t
+node_pool_peak_count(struct node_pool_t *pool)
+{
+    return pool->peak_count;
+}
+
+int64_t
+node_pool_free_count(struct node_pool_t *pool)
+{
+    return pool->slab_count * pool->nodes_per_slab - pool->live_count;
+}
+
+// free
+void
+node_pool_free(void *node)
+{
+    if (node == NULL) { return; }
+
+    struct node_slab_t *slab = node_slab_for_node(node);
+    struct node_pool_t *pool = slab->pool;
+
+    int64_t index = node_slab_index_for_node(slab, node);
+    SE_ASSERT(slab->live[index / 64] & ((uint64_t) 1 << (index % 64)));
+    slab->live[index / 64] &= ~((uint64_t) 1 << (index % 64));
+
+    *((void **) node) = pool->free_list;
+    pool->free_list = node;
+
+    pool->live_count -= 1;
+}
+
+void
+node_pool_release(struct node_pool_t *pool, node_release_fn_t release_fn)
+{
+    if (pool == NULL) { return; }
+
+    struct node_slab_t *slab = pool->slabs;
+    while (slab != NULL) {
+        if (release_fn != NULL) {
+            for (int64_t n = 0; n < slab->used_count; n++) {
+                if (slab->live[n / 64] & ((uint64_t) 1 << (n % 64))) {
+                    release_fn(slab->nodes + n * pool->node_size);
+                }
+            }
+        }
+
+        struct node_slab_t *next = slab->next;
+        free(slab);
+        slab = next;
+    }
+
+    se_free(pool);
+}
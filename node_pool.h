@@ -0,0 +1,71 @@
+#ifndef SE_NODE_POOL_H
+#define SE_NODE_POOL_H
+
+#include <stdint.h>
+
+// nodes are carved out of slabs of this many bytes. slabs are aligned to their size, so the slab (and the pool)
+// a node belongs to is found by masking its address, and a node can be freed without knowing its pool
+#define NODE_POOL_SLAB_BYTES (64 * 1024)
+
+// enough live bits for a slab full of the smallest allowed node
+#define NODE_POOL_MIN_NODE_SIZE 32
+#define NODE_POOL_MAX_NODES_PER_SLAB (NODE_POOL_SLAB_BYTES / NODE_POOL_MIN_NODE_SIZE)
+
+struct node_slab_t {
+    struct node_pool_t *pool;
+    struct node_slab_t *next;
+
+    // bit n is set while node n is handed out
+    uint64_t live[NODE_POOL_MAX_NODES_PER_SLAB / 64];
+
+    // nodes past this one have never been handed out
+    int64_t used_count;
+
+    char *nodes;
+};
+
+struct node_pool_t {
+    int64_t node_size;
+    int64_t nodes_per_slab;
+
+    struct node_slab_t *slabs;
+
+    // freed nodes, linked through their first bytes
+    void *free_list;
+
+    int64_t slab_count;
+    int64_t live_count;
+    int64_t peak_count;
+};
+
+typedef void (*node_release_fn_t)(void *node);
+
+struct node_pool_t *
+node_pool_init(int64_t node_size);
+
+// zeroed, like se_alloc
+void *
+node_pool_alloc(struct node_pool_t *pool);
+
+void
+node_pool_free(void *node);
+
+// hands every node still live to release_fn (if given), then frees the whole pool at once
+void
+node_pool_release(struct node_pool_t *pool, node_release_fn_t release_fn);
+
+// the pool that handed the node out
+struct node_pool_t *
+node_pool_for_node(void *node);
+
+int64_t
+node_pool_live_count(struct node_pool_t *pool);
+
+int64_t
+node_pool_peak_count(struct node_pool_t *pool);
+
+// nodes that can be handed out without allocating another slab
+int64_t
+node_pool_free_count(struct node_pool_t *pool);
+
+#endif //SE_NODE_POOL_H
@@ -6,26 +6,105 @@
 #include "util.h"
 #include "buf.h"
 #include "circular_buffer.h"
-#include "line_rope.h"
+#include "editor_buffer.h"
+#include "leaf_store.h"
+#include "node_pool.h"
+#include "scan.h"
 
-#define SPLIT_THRESHOLD 2048 * 16
-#define COPY_THRESHOLD 2048 * 16
+#define SPLIT_THRESHOLD (2048 * 16)
+#define COPY_THRESHOLD (2048 * 16)
+
+// neighbouring leaves are only merged when one of them is this small, so an edit in the middle of a
+// big leaf doesn't copy the whole thing back together again
+#define MERGE_THRESHOLD 1024
+
+// spare bytes given to a leaf that's had text appended to it, so the next few appends happen in place
+#define APPEND_RESERVE 1024
+
+// chars between entries in a leaf's char_checkpoints
+#define CHECKPOINT_INTERVAL 256
+
+// leaves shorter than this aren't worth looking up in the leaf store
+#define LEAF_STORE_THRESHOLD 1024
+
+// rope_wrap_locate_rows walks forward line by line to a row at most this many rows on, and descends again for
+// one further away
+#define WRAP_WALK_ROWS 64
+
+// lines at least this long have their row counts kept on the leaf they end in (see rope_wrap_rows_for_line), so
+// they're only walked again once they change
+#define WRAP_LINE_CACHE_THRESHOLD 512
 
 // forward declarations
+struct node_pool_t *
+rope_current_pool(int8_t is_leaf);
+
+int8_t
+rope_node_in_current_pool(struct rope_t *rn);
+
+struct rope_t *
+rope_node_alloc(int8_t is_leaf);
+
 struct rope_t *
 rope_new(int8_t is_leaf, int64_t byte_weight, int64_t char_weight);
 
+struct rope_t *
+rope_parent_init_children(struct rope_t **children, int64_t count);
+
+struct rope_t *
+rope_parent_init_many(struct rope_t **children, int64_t count);
+
+int64_t
+rope_parent_init_siblings(struct rope_t **children, int64_t count, struct rope_t **out_siblings);
+
+struct rope_t *
+rope_parent_init_range(struct rope_t *rn, int8_t start, int8_t count);
+
+struct rope_t *
+rope_parent_replace_child(struct rope_t *rn, int8_t k, struct rope_t *replacement);
+
+void
+rope_update_weights(struct rope_t *rn);
+
+struct rope_t *
+rope_build_from_leaves(struct vector_t *nodes);
+
+void
+rope_pack_leaves(struct vector_t *leaves, struct vector_t *packed);
+
+void
+rope_leaf_index(struct rope_t *leaf, struct rope_t *indexed_prefix);
+
 int64_t
-rope_byte_weight(struct rope_t *rn);
+rope_leaf_byte_offset_for_char(struct rope_t *leaf, int64_t i);
 
 int64_t
-rope_char_weight(struct rope_t *rn);
+rope_leaf_char_for_byte_offset(struct rope_t *leaf, int64_t byte_offset);
 
 int64_t
-rope_line_break_weight(struct rope_t *rn);
+rope_count_line_breaks(const char *bytes, int64_t byte_length);
+
+struct rope_line_break_t *
+rope_leaf_line_breaks(struct rope_t *leaf);
+
+int64_t
+rope_leaf_line_breaks_before_byte(struct rope_t *leaf, int64_t byte_offset);
 
 int64_t
-count_newlines_length(const char *str, int64_t i, struct line_helper_t *line_helper);
+rope_leaf_line_breaks_before_char(struct rope_t *leaf, int64_t char_offset);
+
+int8_t
+rope_leaf_has_line_breaks(struct rope_t *leaf);
+
+void
+rope_leaf_copy_line_breaks(struct rope_t *leaf, struct rope_line_break_t *from,
+                           int64_t byte_shift, int64_t char_shift);
+
+int8_t
+rope_child_for_char(struct rope_t *rn, int64_t i);
+
+int8_t
+rope_child_for_byte(struct rope_t *rn, int64_t i);
 
 void
 rope_split_at_char(struct rope_t *rn, int64_t i,
@@ -35,417 +114,2834 @@ rope_split_at_char(struct rope_t *rn, int64_t i,
 struct rope_t *
 rope_concat(struct rope_t *left, struct rope_t *right);
 
-// init
 struct rope_t *
-rope_parent_init(struct rope_t *left, struct rope_t *right)
-{
-    struct rope_t *rn = rope_new(0, rope_byte_weight(left), rope_char_weight(left));
+rope_concat_same_height(struct rope_t *left, struct rope_t *right);
 
-    rope_set_left(rn, left);
-    rope_set_right(rn, right);
+uint64_t
+rope_hash_reduce(unsigned __int128 x);
 
-    rn->byte_weight = rope_byte_weight(rn);
-    rn->total_byte_weight = rope_total_byte_weight(rn);
+uint64_t
+rope_hash_join(uint64_t left_hash, uint64_t right_hash, int64_t right_byte_length);
 
-    rn->char_weight = rope_char_weight(rn);
-    rn->total_char_weight = rope_total_char_weight(rn);
+uint64_t
+rope_hash_power(int64_t n);
 
-    rn->line_break_weight = rope_line_break_weight(rn);
-    rn->total_line_break_weight = rope_total_line_break_weight(rn);
+uint64_t
+rope_hash_bytes(uint64_t hash, const char *bytes, int64_t byte_length);
 
-    return rn;
-}
+void
+rope_update_hash(struct rope_t *rn);
+
+uint64_t
+rope_hash_bytes_between(struct rope_t *rn, uint64_t hash, int64_t start, int64_t end);
+
+void
+rope_iter_init_at_root(struct rope_iter_t *iter, struct rope_t *rn);
+
+void
+rope_iter_descend_to_byte(struct rope_iter_t *iter, int64_t i);
+
+void
+rope_iter_descend_to_char(struct rope_iter_t *iter, int64_t i);
+
+void
+rope_iter_descend_to_line(struct rope_iter_t *iter, int64_t line);
 
 struct rope_t *
-rope_leaf_init_length(const char *text, int64_t byte_length, int64_t char_length, struct line_helper_t *line_helper)
-{
-    if (char_length > SPLIT_THRESHOLD) {
-        int64_t half = char_length / 2;
+rope_iter_push(struct rope_iter_t *iter, int8_t k);
 
-        const char *half_ptr = text;
-        for (int64_t i = 0; i < half; i++) {
-            half_ptr += bytes_in_codepoint_utf8(*half_ptr);
-        }
+void
+rope_iter_pop(struct rope_iter_t *iter);
 
-        int64_t first_half_byte_length = (int64_t) (half_ptr - text);
+void
+rope_iter_skip_leaf_end(struct rope_iter_t *iter);
 
-        struct rope_t *left = rope_leaf_init_length(text, first_half_byte_length, half, line_helper);
-        struct rope_t *right = rope_leaf_init_length(half_ptr, byte_length - first_half_byte_length, char_length - half, line_helper);
-        return rope_parent_init(left, right);
-    } else {
-        struct rope_t *rn = rope_new(1, byte_length, char_length);
+void
+rope_iter_line_start(struct rope_iter_t *iter);
 
-        buf_id += 1;
-        rn->str_buf = buf_init_fmt("%bytes", text, byte_length);
+struct rope_t *
+rope_leaf_init_concat(struct rope_t *left, struct rope_t *right);
 
-        rn->line_break_weight = count_newlines_length(text, char_length, line_helper);
-        rn->total_line_break_weight = rn->line_break_weight;
-        return rn;
-    }
-}
+const char *
+rope_leaf_cut(const char *leaf_start, const char *end);
+
+void
+rope_collect_leaves_deduped(const char *bytes, int64_t byte_length, struct vector_t *leaves);
+
+int64_t
+rope_write_replacing_invalid_utf8(const char *bytes, int64_t byte_length, int64_t first_invalid,
+                                  struct buf_t *out);
+
+int8_t
+rope_contains_replacement_char(const char *bytes, int64_t byte_length);
 
 struct rope_t *
-rope_leaf_init(const char *text)
-{
-    return rope_leaf_init_length(text, (int64_t) strlen(text), unicode_strlen(text), NULL);
-}
+rope_leaf_init_slice(struct buf_t *str_buf, int64_t str_offset,
+                     int64_t byte_length, int64_t char_length, int64_t line_break_count,
+                     struct rope_t *indexed_prefix);
+
+int8_t
+rope_leaves_adjacent(struct rope_t *left, struct rope_t *right);
+
+int8_t
+rope_leaf_can_append(struct rope_t *leaf, int64_t byte_count);
+
+int64_t *
+rope_summary_values(struct rope_t *rn);
+
+void
+rope_leaf_summarize(struct rope_t *leaf);
+
+void
+rope_parent_summarize(struct rope_t *rn);
+
+void
+rope_summary_combine_nodes(struct rope_t *rn, struct rope_t *left, struct rope_t *right);
+
+void
+rope_leaf_update_line_summary(struct rope_t *leaf, int64_t wrap_width);
+
+int64_t
+rope_wrap_rows_for_line_length(int64_t line_length, int64_t wrap_width);
+
+int8_t
+rope_wrap_cache_slot(struct rope_t *rn, int64_t wrap_width);
+
+void
+rope_wrap_cache_add(struct rope_t *rn, int64_t wrap_width, int64_t rows);
+
+int64_t
+rope_wrap_rows_inside(struct rope_t *rn, int64_t wrap_width);
+
+int64_t
+rope_wrap_rows_for_line(struct rope_t *rn, int64_t start, int64_t line_length, int64_t wrap_width);
+
+int64_t
+rope_wrap_walk(struct rope_iter_t *iter, int64_t line_length, int64_t wrap_width,
+               int64_t max_rows, int64_t max_start, int64_t *out_row_start);
+
+void
+rope_wrap_walk_init(struct rope_wrap_walk_t *walk, struct rope_iter_t *iter);
+
+void
+rope_wrap_walk_on(struct rope_wrap_walk_t *walk, int64_t line_length, int64_t wrap_width,
+                  int64_t max_rows, int64_t max_start);
+
+int64_t
+rope_wrap_char_width(struct rope_iter_t *iter, int64_t col, int64_t wrap_width);
+
+int64_t
+rope_wrap_row_start_in_line(struct rope_t *rn, int64_t wrap_width, int64_t line_start, int64_t line_length,
+                            int64_t row);
+
+int64_t
+rope_wrap_char_in_row(struct rope_t *rn, int64_t wrap_width, int64_t line_start, int64_t line_length, int64_t row,
+                      int64_t display_col);
+
+int8_t
+rope_get_row_fragments(struct rope_iter_t *iter, int64_t line, int64_t row_start, int64_t row_end,
+                       int64_t row_end_byte, struct rope_rows_t *out);
 
+// init
+// takes its own reference to str_buf, the caller keeps (and eventually frees) the one it had
 struct rope_t *
-rope_leaf_init_lines(const char *text, struct line_helper_t *line_helper)
+rope_leaf_init_slice(struct buf_t *str_buf, int64_t str_offset,
+                     int64_t byte_length, int64_t char_length, int64_t line_break_count,
+                     struct rope_t *indexed_prefix)
 {
-    return rope_leaf_init_length(text, (int64_t) strlen(text), unicode_strlen(text), line_helper);
+    struct rope_t *rn = rope_new(1, byte_length, char_length);
+
+    rn->str_buf = str_buf;
+    rn->str_buf->rc += 1;
+    rn->str_offset = str_offset;
+
+    rn->total_line_break_weight = line_break_count;
+
+    rope_leaf_index(rn, indexed_prefix);
+    return rn;
 }
 
-// methods
-void
-rope_set_right(struct rope_t *target, struct rope_t *new_right)
+struct rope_t *
+rope_leaf_init_bytes(const char *bytes, int64_t byte_length, int64_t char_length, int64_t line_break_count)
 {
-    SE_ASSERT(target != NULL);
-    SE_ASSERT(target != new_right);
-    SE_ASSERT(!target->is_leaf);
+    buf_id += 1;
+    struct buf_t *str_buf = buf_init_inline(byte_length);
+    buf_write_bytes(str_buf, bytes, byte_length);
 
-    if (new_right == target->right) { return; }
+    struct rope_t *rn = rope_leaf_init_slice(str_buf, 0, byte_length, char_length, line_break_count, NULL);
+    rope_leaf_summarize(rn);
 
-    rope_dec_rc(target->right);
-    target->right = new_right;
-    rope_inc_rc(new_right);
+    buf_free(str_buf);
+    return rn;
+}
 
-    rope_total_byte_weight(target);
-    rope_total_line_break_weight(target);
-    rope_total_char_weight(target);
+const char *
+rope_leaf_bytes(struct rope_t *leaf)
+{
+    return leaf->str_buf->bytes + leaf->str_offset;
 }
 
+// chop the text into leaves of at most SPLIT_THRESHOLD bytes, never splitting a codepoint, and count each
+// leaf's chars and line breaks with the scan kernels.
+// the text is copied once, into a buffer every one of the leaves is a slice of. any invalid utf-8 is replaced
+// with U+FFFD on the way, so everything that walks a leaf's codepoints can trust them
 void
-rope_set_left(struct rope_t *target, struct rope_t *new_left)
+rope_collect_leaves(const char *bytes, int64_t byte_length, struct vector_t *leaves)
 {
-    SE_ASSERT(target != NULL);
-    SE_ASSERT(target != new_left);
-    SE_ASSERT(!target->is_leaf);
+    int64_t first_invalid = scan_find_invalid_utf8(bytes, byte_length);
+    int8_t has_replacement_chars = first_invalid < byte_length;
+
+    if (rope_leaf_store != NULL && !has_replacement_chars) {
+        rope_collect_leaves_deduped(bytes, byte_length, leaves);
+        return;
+    }
+
+    buf_id += 1;
+    struct buf_t *str_buf;
+    if (!has_replacement_chars) {
+        str_buf = buf_init_inline(byte_length);
+        buf_write_bytes(str_buf, bytes, byte_length);
+    } else {
+        int64_t repaired_length = rope_write_replacing_invalid_utf8(bytes, byte_length, first_invalid, NULL);
+        str_buf = buf_init_inline(repaired_length);
+        rope_write_replacing_invalid_utf8(bytes, byte_length, first_invalid, str_buf);
+        byte_length = repaired_length;
+    }
+
+    const char *text = str_buf->bytes;
+    const char *end = text + byte_length;
+    const char *leaf_start = text;
 
-    if (new_left == target->left) { return; }
+    while (leaf_start < end) {
+        const char *c = rope_leaf_cut(leaf_start, end);
 
-    rope_dec_rc(target->left);
-    target->left = new_left;
-    rope_inc_rc(new_left);
+        int64_t char_count = scan_count_codepoints(leaf_start, (int64_t) (c - leaf_start));
+        int64_t line_break_count = scan_count_byte(leaf_start, (int64_t) (c - leaf_start), '\n');
 
-    target->byte_weight = rope_byte_weight(target);
-    rope_total_byte_weight(target);
+        struct rope_t *leaf = rope_leaf_init_slice(str_buf, (int64_t) (leaf_start - text),
+                                                   (int64_t) (c - leaf_start), char_count, line_break_count, NULL);
+        leaf->has_replacement_chars = has_replacement_chars
+                                      && rope_contains_replacement_char(leaf_start, (int64_t) (c - leaf_start));
+        rope_leaf_summarize(leaf);
+        vector_append(leaves, &leaf);
 
-    target->char_weight = rope_char_weight(target);
-    rope_total_char_weight(target);
+        leaf_start = c;
+    }
 
-    target->line_break_weight = rope_line_break_weight(target);
-    rope_total_line_break_weight(target);
+    buf_free(str_buf);
 }
 
+// where the leaf starting at leaf_start ends: SPLIT_THRESHOLD bytes on, or at end, whichever comes first
 const char *
-rope_char_at(struct rope_t *rn, int64_t i)
+rope_leaf_cut(const char *leaf_start, const char *end)
 {
-    if (rn == NULL) { return NULL; }
-    
-    if (rn->is_leaf) {
-        if (rn->char_weight - 1 < i) {
-            return NULL;
+    const char *c = end - leaf_start > SPLIT_THRESHOLD ? leaf_start + SPLIT_THRESHOLD : end;
+
+    // back up to the start of the codepoint the cut landed in (unless it's nothing but continuation bytes)
+    const char *cut = c;
+    while (cut > leaf_start && cut < end && (*cut & 0xC0) == 0x80) { cut -= 1; }
+    if (cut > leaf_start) { c = cut; }
+
+    return c;
+}
+
+// rope_collect_leaves for valid utf-8 while there's a leaf store. the leaves are cut in the same places, but
+// any the store already has are shared, and only the rest of the text is copied into a new buffer
+void
+rope_collect_leaves_deduped(const char *bytes, int64_t byte_length, struct vector_t *leaves)
+{
+    int64_t first_leaf = leaves->length;
+    const char *end = bytes + byte_length;
+
+    // find the leaves the store has first, so the new buffer is only as big as what's left over.
+    // the others get a NULL for now
+    struct vector_t *hashes = vector_init(byte_length / SPLIT_THRESHOLD + 1, sizeof(uint64_t));
+    int64_t missing_byte_length = 0;
+
+    for (const char *leaf_start = bytes; leaf_start < end;) {
+        const char *c = rope_leaf_cut(leaf_start, end);
+        int64_t length = (int64_t) (c - leaf_start);
+
+        uint64_t hash = 0;
+        struct rope_t *leaf = NULL;
+        if (length >= LEAF_STORE_THRESHOLD) {
+            hash = rope_hash_bytes(0, leaf_start, length);
+            leaf = leaf_store_find(rope_leaf_store, hash, leaf_start, length);
         }
 
-        int32_t byte_offset = 0;
-        for (int32_t j = 0; j < i; j++) {
-            byte_offset += bytes_in_codepoint_utf8(*(rn->str_buf->bytes + byte_offset));
+        // a leaf from another buffer's pools can't be shared as it is (it goes when that buffer does),
+        // but its text can
+        if (leaf != NULL && !rope_node_in_current_pool(leaf)) {
+            leaf = rope_shallow_copy(leaf);
         }
-        return rn->str_buf->bytes + byte_offset;
+        if (leaf == NULL) {
+            missing_byte_length += length;
+        }
+
+        vector_append(leaves, &leaf);
+        vector_append(hashes, &hash);
+        leaf_start = c;
     }
 
-    if (rn->char_weight - 1 < i) {
-        return rope_char_at(rn->right, i - rn->char_weight);
-    } else {
-        if (rn->left != NULL) {
-            return rope_char_at(rn->left, i);
+    buf_id += 1;
+    struct buf_t *str_buf = buf_init_inline(missing_byte_length);
+
+    int64_t n = first_leaf;
+    for (const char *leaf_start = bytes; leaf_start < end; n++) {
+        const char *c = rope_leaf_cut(leaf_start, end);
+        int64_t length = (int64_t) (c - leaf_start);
+
+        struct rope_t **slot = vector_at(leaves, n);
+        if (*slot == NULL) {
+            int64_t str_offset = str_buf->length;
+            buf_write_bytes(str_buf, leaf_start, length);
+
+            struct rope_t *leaf = rope_leaf_init_slice(str_buf, str_offset, length,
+                                                       scan_count_codepoints(leaf_start, length),
+                                                       scan_count_byte(leaf_start, length, '\n'), NULL);
+            rope_leaf_summarize(leaf);
+
+            if (length >= LEAF_STORE_THRESHOLD) {
+                leaf->hash = *(uint64_t *) vector_at(hashes, n - first_leaf);
+                leaf->has_hash = 1;
+                leaf_store_add(rope_leaf_store, leaf);
+                leaf->in_leaf_store = 1;
+            }
+
+            *slot = leaf;
         }
-        return NULL;
+
+        leaf_start = c;
     }
+
+    buf_free(str_buf);
+    vector_free(hashes);
 }
 
-int64_t
-rope_char_number_at_line(struct rope_t *rn, int64_t i)
+struct rope_t *
+rope_leaf_init_length(const char *text, int64_t byte_length)
 {
-    if (rn == NULL) {
-        return 0;
-    }
+    struct vector_t *leaves = vector_init(byte_length / SPLIT_THRESHOLD + 1, sizeof(struct rope_t *));
+    rope_collect_leaves(text, byte_length, leaves);
 
-    if (rn->is_leaf) {
-        if (rn->line_break_weight < i) {
-            return rn->char_weight + 1;
-        }
+    struct rope_t *rn = rope_build_from_leaves(leaves);
 
-        int32_t byte_offset = 0;
-        int64_t char_number = 0;
-        for (int32_t j = 0; j < i; j++) {
-            while (*(rn->str_buf->bytes + byte_offset) != '\n') {
-                byte_offset += bytes_in_codepoint_utf8(*(rn->str_buf->bytes + byte_offset));
-                char_number += 1;
-            }
+    vector_free(leaves);
+    return rn;
+}
 
-            // go one further so that we skip the actual '\n' character itself
-            byte_offset += bytes_in_codepoint_utf8(*(rn->str_buf->bytes + byte_offset));
-            char_number += 1;
-        }
+struct rope_t *
+rope_leaf_init(const char *text)
+{
+    return rope_leaf_init_length(text, (int64_t) strlen(text));
+}
 
-        return char_number;
+void
+rope_leaf_store_set_enabled(int8_t enabled)
+{
+    if (enabled && rope_leaf_store == NULL) {
+        rope_leaf_store = leaf_store_init();
+    } else if (!enabled && rope_leaf_store != NULL) {
+        // the leaves still marked as being in it find it gone when they're released
+        leaf_store_free(rope_leaf_store);
+        rope_leaf_store = NULL;
     }
+}
 
-    if (rn->line_break_weight < i) {
-        int64_t left_char_length = rope_total_char_length(rn->left);
-        int64_t extra = rope_char_number_at_line(rn->right, i - rn->line_break_weight);
-        return left_char_length + extra;
-    }
-    if (rn->left != NULL) {
-        return rope_char_number_at_line(rn->left, i);
+struct rope_t *
+rope_parent_init_children(struct rope_t **children, int64_t count)
+{
+    SE_ASSERT(count > 0 && count <= ROPE_MAX_CHILDREN);
+
+    struct rope_t *rn = rope_new(0, 0, 0);
+
+    for (int8_t k = 0; k < count; k++) {
+        SE_ASSERT(children[k]->height == children[0]->height);
+
+        rn->children[k] = children[k];
+        rope_inc_rc(children[k]);
     }
-    return 0;
+    rn->child_count = (int8_t) count;
+
+    rope_update_weights(rn);
+
+    return rn;
 }
 
 int64_t
-editor_buffer_add_char_incremental(struct rope_t *rn, int64_t start, int64_t end, struct buf_t *buf);
+rope_parent_init_siblings(struct rope_t **children, int64_t count, struct rope_t **out_siblings)
+{
+    if (count <= ROPE_MAX_CHILDREN) {
+        out_siblings[0] = rope_parent_init_children(children, count);
+        return 1;
+    }
 
-int64_t
-editor_buffer_add_bytes_incremental(struct rope_t *rn, int64_t start, int64_t end, struct buf_t *buf);
+    // too many for one node, so split them evenly between two siblings.
+    // anything over ROPE_MAX_CHILDREN halves to at least ROPE_MIN_CHILDREN each
+    SE_ASSERT(count <= 2 * ROPE_MAX_CHILDREN);
 
-const char
-rope_byte_at(struct rope_t *rn, int64_t i)
+    int64_t half = count / 2;
+
+    out_siblings[0] = rope_parent_init_children(children, half);
+    out_siblings[1] = rope_parent_init_children(children + half, count - half);
+    return 2;
+}
+
+struct rope_t *
+rope_parent_init_many(struct rope_t **children, int64_t count)
 {
-    if (rn->is_leaf) {
-        if (rn->byte_weight - 1 < i) {
-            return -1;
-        }
-        return *(rn->str_buf->bytes + i);
+    struct rope_t *siblings[2];
+    int64_t sibling_count = rope_parent_init_siblings(children, count, siblings);
+
+    if (sibling_count == 1) {
+        return siblings[0];
     }
 
-    if (rn->byte_weight - 1 < i) {
-        return rope_byte_at(rn->right, i - rn->byte_weight);
-    } else {
-        if (rn->left != NULL) {
-            return rope_byte_at(rn->left, i);
-        }
-        return -1;
+    return rope_parent_init_children(siblings, 2);
+}
+
+struct rope_t *
+rope_parent_init_range(struct rope_t *rn, int8_t start, int8_t count)
+{
+    if (count <= 0) { return NULL; }
+
+    // never make a parent with a single child, just hand back (a copy of) the child itself
+    if (count == 1) {
+        return rope_shallow_copy(rn->children[start]);
     }
+
+    return rope_parent_init_children(rn->children + start, count);
 }
 
 struct rope_t *
-rope_byte_at_incremental(struct rope_t *rn, struct rope_t *leaf, int64_t i, int64_t *out)
+rope_parent_replace_child(struct rope_t *rn, int8_t k, struct rope_t *replacement)
 {
-    if (leaf != NULL) {
-        SE_ASSERT(leaf->is_leaf);
+    struct rope_t *children[2 * ROPE_MAX_CHILDREN];
+    int64_t count = 0;
 
-        if (leaf->byte_weight - 1 >= i) {
-            *out = i;
-            return leaf;
-        }
+    for (int8_t j = 0; j < k; j++) {
+        children[count++] = rn->children[j];
     }
 
-    if (rn->is_leaf) {
-        if (rn->byte_weight - 1 < i) {
-            *out = -1;
+    // the replacement is either a sibling of the old child, or it outgrew it and became a parent of
+    // siblings, in which case its children are spliced in directly to keep every leaf at the same depth
+    int8_t spliced = replacement->height == rn->height;
+    if (spliced) {
+        for (int8_t j = 0; j < replacement->child_count; j++) {
+            children[count++] = replacement->children[j];
         }
-        *out = i;
-        return rn;
-    }
-    if (rn->byte_weight - 1 < i) {
-        return rope_byte_at_incremental(rn->right, NULL, i - rn->byte_weight, out);
     } else {
-        if (rn->left != NULL) {
-            return rope_byte_at_incremental(rn->left, NULL, i, out);
-        }
-        *out = -1;
+        SE_ASSERT(replacement->height == rn->height - 1);
+        children[count++] = replacement;
     }
 
-    *out = -1;
-    return NULL;
-}
+    for (int8_t j = (int8_t) (k + 1); j < rn->child_count; j++) {
+        children[count++] = rn->children[j];
+    }
 
-int64_t
-rope_char_for_byte_at(struct rope_t *rn, int64_t i)
-{
-    if (rn->is_leaf) {
-        if (rn->byte_weight - 1 < i) {
-            return 0;
+    // an underfull replacement gets its children pooled with a neighbour's and shared back out,
+    // so the seam left behind by a split doesn't leave a thin node in the middle of the tree
+    int8_t pooled = !spliced && !replacement->is_leaf && replacement->child_count < ROPE_MIN_CHILDREN && count > 1;
+    if (pooled) {
+        int64_t lo = k > 0 ? k - 1 : k;
+
+        struct rope_t *pooled[2 * ROPE_MAX_CHILDREN];
+        int64_t pooled_count = 0;
+        for (int64_t n = lo; n < lo + 2; n++) {
+            for (int8_t j = 0; j < children[n]->child_count; j++) {
+                pooled[pooled_count++] = children[n]->children[j];
+            }
         }
 
-        int64_t char_ = 0;
-        int64_t byte = 0;
-        const char *bytes = rn->str_buf->bytes;
-        while (byte < i) {
-            byte += bytes_in_codepoint_utf8(*(bytes + byte));
-            char_ += 1;
+        struct rope_t *siblings[2];
+        int64_t sibling_count = rope_parent_init_siblings(pooled, pooled_count, siblings);
+
+        children[lo] = siblings[0];
+        if (sibling_count == 2) {
+            children[lo + 1] = siblings[1];
+        } else {
+            memmove(children + lo + 1, children + lo + 2, (size_t) (count - lo - 2) * sizeof(struct rope_t *));
+            count -= 1;
         }
+    }
 
-        return char_;
+    struct rope_t *result = rope_parent_init_many(children, count);
+
+    // spliced or pooled, the replacement's children have been adopted and the node itself is no longer referenced
+    if (spliced || pooled) {
+        rope_free(replacement);
     }
 
-    if (rn->byte_weight - 1 < i) {
-        int64_t left_weight = rn->left == NULL ? 0 : rn->left->total_char_weight;
-        return left_weight + rope_char_for_byte_at(rn->right, i - rn->byte_weight);
-    } else {
-        if (rn->left != NULL) {
-            return rope_char_for_byte_at(rn->left, i);
+    return result;
+}
+
+struct rope_t *
+rope_build_from_leaves(struct vector_t *nodes)
+{
+    if (nodes->length == 0) {
+        return rope_leaf_init_bytes("", 0, 0, 0);
+    }
+
+    // build the tree one level at a time, spreading each level's nodes evenly across as few parents as possible
+    while (nodes->length > 1) {
+        int64_t parent_count = (nodes->length + ROPE_MAX_CHILDREN - 1) / ROPE_MAX_CHILDREN;
+        int64_t per_parent = nodes->length / parent_count;
+        int64_t extra = nodes->length % parent_count;
+
+        int64_t read = 0;
+        for (int64_t p = 0; p < parent_count; p++) {
+            int64_t count = per_parent + (p < extra ? 1 : 0);
+
+            struct rope_t *parent = rope_parent_init_children((struct rope_t **) vector_at(nodes, read), count);
+            vector_set_at(nodes, p, &parent);
+
+            read += count;
         }
-        return 0;
+        nodes->length = parent_count;
     }
+
+    return (struct rope_t *) vector_at_deref(nodes, 0);
 }
 
-int64_t
-byte_for_char_at(struct rope_t *rn, int64_t i)
+// methods
+void
+rope_update_weights(struct rope_t *rn)
 {
-    if (rn == NULL) { return 0; }
+    if (rn->is_leaf) { return; }
 
-    if (rn->is_leaf) {
-        if (rn->char_weight - 1 < i) {
-            return rn->byte_weight;
-        }
+    int64_t bytes = 0;
+    int64_t chars = 0;
+    int64_t line_breaks = 0;
+    int8_t has_replacement_chars = 0;
 
-        int32_t byte_offset = 0;
-        for (int32_t j = 0; j < i; j++) {
-            byte_offset += bytes_in_codepoint_utf8(*(rn->str_buf->bytes + byte_offset));
-        }
+    for (int8_t k = 0; k < rn->child_count; k++) {
+        struct rope_t *child = rn->children[k];
 
-        return byte_offset;
-    }
+        bytes += child->total_byte_weight;
+        chars += child->total_char_weight;
+        line_breaks += child->total_line_break_weight;
+        has_replacement_chars |= child->has_replacement_chars;
 
-    if (rn->char_weight - 1 < i) {
-        int64_t left_weight = rn->left == NULL ? 0 : rn->left->total_byte_weight;
-        return left_weight + byte_for_char_at(rn->right, i - rn->left->total_char_weight);
-    } else if (rn->left != NULL) {
-        return byte_for_char_at(rn->left, i);
+        rn->byte_prefix[k] = bytes;
+        rn->char_prefix[k] = chars;
+        rn->line_break_prefix[k] = line_breaks;
     }
 
-    return 0;
+    rn->total_byte_weight = bytes;
+    rn->total_char_weight = chars;
+    rn->total_line_break_weight = line_breaks;
+    rn->has_replacement_chars = has_replacement_chars;
+
+    rn->height = (int8_t) (rn->children[0]->height + 1);
+
+    // the line summary and hash are left for whoever needs them next, so edits that never ask about them
+    // don't pay for them
+    rn->has_line_summary = 0;
+    memset(rn->wrap_widths, 0, sizeof(rn->wrap_widths));
+    rn->has_hash = 0;
+
+    rope_parent_summarize(rn);
 }
 
-int64_t
-rope_total_char_length(struct rope_t *rn)
+int8_t
+rope_child_for_char(struct rope_t *rn, int64_t i)
 {
-    if (rn == NULL) { return 0; }
+    int8_t k = 0;
+    while (k < rn->child_count - 1 && rn->char_prefix[k] <= i) {
+        k += 1;
+    }
+    return k;
+}
 
-    return rn->total_char_weight;
+int8_t
+rope_child_for_byte(struct rope_t *rn, int64_t i)
+{
+    int8_t k = 0;
+    while (k < rn->child_count - 1 && rn->byte_prefix[k] <= i) {
+        k += 1;
+    }
+    return k;
 }
 
-int64_t
-rope_total_char_weight(struct rope_t *rn)
+// fills in is_ascii and char_checkpoints. indexed_prefix, if given, is an already indexed leaf
+// whose bytes this one starts with, so its checkpoints are reused instead of walked again
+void
+rope_leaf_index(struct rope_t *leaf, struct rope_t *indexed_prefix)
 {
-    if (rn == NULL) { return 0; }
+    leaf->is_ascii = leaf->total_byte_weight == leaf->total_char_weight;
+    leaf->char_checkpoints = NULL;
+
+    int64_t checkpoint_count = leaf->total_char_weight > 0 ? (leaf->total_char_weight - 1) / CHECKPOINT_INTERVAL : 0;
+    if (leaf->is_ascii || checkpoint_count == 0) { return; }
+
+    leaf->char_checkpoints = se_alloc(checkpoint_count, sizeof(int32_t));
+
+    int64_t k = 0;
+    int64_t byte_offset = 0;
 
-    if (rn->left != NULL && rn->right != NULL) {
-        rn->total_char_weight = rn->left->total_char_weight + rn->right->total_char_weight;
+    if (indexed_prefix != NULL && indexed_prefix->total_char_weight > 0) {
+        // the prefix may also be longer than the leaf, when the leaf is the left half of it
+        int64_t prefix_count = (indexed_prefix->total_char_weight - 1) / CHECKPOINT_INTERVAL;
+        if (prefix_count > checkpoint_count) { prefix_count = checkpoint_count; }
+
+        if (indexed_prefix->is_ascii) {
+            for (; k < prefix_count; k++) {
+                leaf->char_checkpoints[k] = (int32_t) ((k + 1) * CHECKPOINT_INTERVAL);
+            }
+        } else if (prefix_count > 0) {
+            memcpy(leaf->char_checkpoints, indexed_prefix->char_checkpoints, (size_t) prefix_count * sizeof(int32_t));
+            k = prefix_count;
+        }
+
+        if (k > 0) { byte_offset = leaf->char_checkpoints[k - 1]; }
     }
-    else if (rn->left != NULL) {
-        rn->total_char_weight = rn->left->total_char_weight;
-    } else if (rn->right != NULL) {
-        rn->total_char_weight = rn->right->total_char_weight;
-    } else {
-        rn->total_char_weight = 0;
+
+    const char *bytes = rope_leaf_bytes(leaf);
+    for (; k < checkpoint_count; k++) {
+        for (int64_t j = 0; j < CHECKPOINT_INTERVAL; j++) {
+            byte_offset += bytes_in_codepoint_utf8(*(bytes + byte_offset));
+        }
+        leaf->char_checkpoints[k] = (int32_t) byte_offset;
     }
+}
+
+int64_t
+rope_leaf_byte_offset_for_char(struct rope_t *leaf, int64_t i)
+{
+    if (i <= 0) { return 0; }
+    if (leaf->is_ascii) { return i; }
+
+    int64_t byte_offset = 0;
+
+    int64_t k = i / CHECKPOINT_INTERVAL;
+    if (k > 0 && leaf->char_checkpoints != NULL) {
+        byte_offset = leaf->char_checkpoints[k - 1];
+        i -= k * CHECKPOINT_INTERVAL;
+    }
+
+    const char *bytes = rope_leaf_bytes(leaf);
+    for (int64_t j = 0; j < i; j++) {
+        byte_offset += bytes_in_codepoint_utf8(*(bytes + byte_offset));
+    }
+
+    return byte_offset;
+}
+
+int64_t
+rope_leaf_char_for_byte_offset(struct rope_t *leaf, int64_t byte_offset)
+{
+    if (leaf->is_ascii) { return byte_offset; }
+
+    int64_t char_number = 0;
+    int64_t byte = 0;
+
+    if (leaf->char_checkpoints != NULL) {
+        // binary search for the last checkpoint at or before byte_offset
+        int64_t lo = 0;
+        int64_t hi = (leaf->total_char_weight - 1) / CHECKPOINT_INTERVAL;
+        while (lo < hi) {
+            int64_t mid = (lo + hi) / 2;
+            if (leaf->char_checkpoints[mid] <= byte_offset) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+
+        if (lo > 0) {
+            byte = leaf->char_checkpoints[lo - 1];
+            char_number = lo * CHECKPOINT_INTERVAL;
+        }
+    }
+
+    const char *bytes = rope_leaf_bytes(leaf);
+    if (byte < byte_offset) { char_number += scan_count_codepoints(bytes + byte, byte_offset - byte); }
+
+    return char_number;
+}
+
+// the leaf's line break table, built on first use. leaves never change once made, so it never goes stale
+struct rope_line_break_t *
+rope_leaf_line_breaks(struct rope_t *leaf)
+{
+    if (leaf->line_breaks != NULL || leaf->total_line_break_weight == 0) {
+        return leaf->line_breaks;
+    }
+
+    leaf->line_breaks = se_alloc(leaf->total_line_break_weight, sizeof(struct rope_line_break_t));
+
+    const char *bytes = rope_leaf_bytes(leaf);
+    int64_t byte_offset = 0;
+    int64_t char_offset = 0;
+    int64_t k = 0;
+    while (k < leaf->total_line_break_weight) {
+        const char *line_break = memchr(bytes + byte_offset, '\n', (size_t) (leaf->total_byte_weight - byte_offset));
+        int64_t line_break_offset = (int64_t) (line_break - bytes);
+
+        if (leaf->is_ascii) {
+            char_offset = line_break_offset;
+        } else {
+            char_offset += scan_count_codepoints(bytes + byte_offset, line_break_offset - byte_offset);
+        }
+        byte_offset = line_break_offset;
+
+        leaf->line_breaks[k].byte_offset = (int32_t) byte_offset;
+        leaf->line_breaks[k].char_offset = (int32_t) char_offset;
+        k += 1;
+
+        byte_offset += 1;
+        char_offset += 1;
+    }
+
+    return leaf->line_breaks;
+}
+
+int8_t
+rope_leaf_has_line_breaks(struct rope_t *leaf)
+{
+    return leaf->line_breaks != NULL || leaf->total_line_break_weight == 0;
+}
+
+// makes leaf's table out of the part of another leaf's table that falls inside it
+void
+rope_leaf_copy_line_breaks(struct rope_t *leaf, struct rope_line_break_t *from,
+                           int64_t byte_shift, int64_t char_shift)
+{
+    if (leaf->total_line_break_weight == 0) { return; }
+
+    leaf->line_breaks = se_alloc(leaf->total_line_break_weight, sizeof(struct rope_line_break_t));
+    for (int64_t k = 0; k < leaf->total_line_break_weight; k++) {
+        leaf->line_breaks[k].byte_offset = (int32_t) (from[k].byte_offset + byte_shift);
+        leaf->line_breaks[k].char_offset = (int32_t) (from[k].char_offset + char_shift);
+    }
+}
+
+int64_t
+rope_leaf_line_breaks_before_byte(struct rope_t *leaf, int64_t byte_offset)
+{
+    struct rope_line_break_t *line_breaks = rope_leaf_line_breaks(leaf);
+
+    int64_t lo = 0;
+    int64_t hi = leaf->total_line_break_weight;
+    while (lo < hi) {
+        int64_t mid = (lo + hi) / 2;
+        if (line_breaks[mid].byte_offset < byte_offset) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+int64_t
+rope_leaf_line_breaks_before_char(struct rope_t *leaf, int64_t char_offset)
+{
+    struct rope_line_break_t *line_breaks = rope_leaf_line_breaks(leaf);
+
+    int64_t lo = 0;
+    int64_t hi = leaf->total_line_break_weight;
+    while (lo < hi) {
+        int64_t mid = (lo + hi) / 2;
+        if (line_breaks[mid].char_offset < char_offset) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+int64_t
+rope_count_line_breaks(const char *bytes, int64_t byte_length)
+{
+    return scan_count_byte(bytes, byte_length, '\n');
+}
+
+const char *
+rope_char_at(struct rope_t *rn, int64_t i)
+{
+    if (rn == NULL) { return NULL; }
+
+    while (!rn->is_leaf) {
+        int8_t k = rope_child_for_char(rn, i);
+        if (k > 0) { i -= rn->char_prefix[k - 1]; }
+        rn = rn->children[k];
+    }
+
+    if (rn->total_char_weight - 1 < i) {
+        return NULL;
+    }
+
+    return rope_leaf_bytes(rn) + rope_leaf_byte_offset_for_char(rn, i);
+}
+
+int64_t
+rope_char_number_at_line(struct rope_t *rn, int64_t i)
+{
+    if (rn == NULL) { return 0; }
+    if (i <= 0) { return 0; }
+
+    int64_t char_number = 0;
+
+    while (!rn->is_leaf) {
+        // find the child holding the i-th line break
+        int8_t k = 0;
+        while (k < rn->child_count && rn->line_break_prefix[k] < i) {
+            k += 1;
+        }
+
+        if (k == rn->child_count) {
+            return char_number + rn->total_char_weight + 1;
+        }
+
+        if (k > 0) {
+            i -= rn->line_break_prefix[k - 1];
+            char_number += rn->char_prefix[k - 1];
+        }
+        rn = rn->children[k];
+    }
+
+    if (rn->total_line_break_weight < i) {
+        return char_number + rn->total_char_weight + 1;
+    }
+
+    return char_number + rope_leaf_line_breaks(rn)[i - 1].char_offset + 1;
+}
+
+const char
+rope_byte_at(struct rope_t *rn, int64_t i)
+{
+    if (rn == NULL) { return -1; }
+
+    while (!rn->is_leaf) {
+        int8_t k = rope_child_for_byte(rn, i);
+        if (k > 0) { i -= rn->byte_prefix[k - 1]; }
+        rn = rn->children[k];
+    }
+
+    if (i < 0 || rn->total_byte_weight - 1 < i) {
+        return -1;
+    }
+    return *(rope_leaf_bytes(rn) + i);
+}
+
+int64_t
+rope_char_for_byte_at(struct rope_t *rn, int64_t i)
+{
+    if (rn == NULL) { return 0; }
+
+    int64_t char_number = 0;
+
+    while (!rn->is_leaf) {
+        int8_t k = rope_child_for_byte(rn, i);
+        if (k > 0) {
+            i -= rn->byte_prefix[k - 1];
+            char_number += rn->char_prefix[k - 1];
+        }
+        rn = rn->children[k];
+    }
+
+    if (rn->total_byte_weight - 1 < i) {
+        return char_number + rn->total_char_weight;
+    }
+
+    return char_number + rope_leaf_char_for_byte_offset(rn, i);
+}
+
+int64_t
+byte_for_char_at(struct rope_t *rn, int64_t i)
+{
+    if (rn == NULL) { return 0; }
+
+    int64_t byte_number = 0;
+
+    while (!rn->is_leaf) {
+        int8_t k = rope_child_for_char(rn, i);
+        if (k > 0) {
+            i -= rn->char_prefix[k - 1];
+            byte_number += rn->byte_prefix[k - 1];
+        }
+        rn = rn->children[k];
+    }
+
+    if (rn->total_char_weight - 1 < i) {
+        return byte_number + rn->total_byte_weight;
+    }
+
+    return byte_number + rope_leaf_byte_offset_for_char(rn, i);
+}
+
+int64_t
+rope_total_char_length(struct rope_t *rn)
+{
+    if (rn == NULL) { return 0; }
+
+    return rn->total_char_weight;
+}
+
+int64_t
+rope_total_char_weight(struct rope_t *rn)
+{
+    if (rn == NULL) { return 0; }
+
+    rope_update_weights(rn);
+    return rn->total_char_weight;
+}
+
+int64_t
+rope_total_line_break_length(struct rope_t *rn)
+{
+    if (rn == NULL) {
+        return 0;
+    }
+
+    return rn->total_line_break_weight;
+}
+
+int64_t
+rope_total_line_break_weight(struct rope_t *rn)
+{
+    if (rn == NULL) { return 0; }
+
+    rope_update_weights(rn);
+    return rn->total_line_break_weight;
+}
+
+int8_t
+rope_has_replacement_chars(struct rope_t *rn)
+{
+    if (rn == NULL) { return 0; }
+
+    return rn->has_replacement_chars;
+}
+
+int64_t
+rope_get_line_number_for_char_pos(struct rope_t *rn, int64_t char_pos)
+{
+    if (rn == NULL) {
+        return 0;
+    }
+
+    int64_t line_count = 0;
+
+    while (!rn->is_leaf) {
+        int8_t k = rope_child_for_char(rn, char_pos);
+        if (k > 0) {
+            char_pos -= rn->char_prefix[k - 1];
+            line_count += rn->line_break_prefix[k - 1];
+        }
+        rn = rn->children[k];
+    }
+
+    if (rn->total_char_weight <= char_pos) {
+        return line_count + rn->total_line_break_weight;
+    }
+
+    return line_count + rope_leaf_line_breaks_before_char(rn, char_pos);
+}
+
+// lines
+int64_t
+rope_wrap_rows_for_line_length(int64_t line_length, int64_t wrap_width)
+{
+    // an empty line still takes up a row
+    if (line_length == 0) { return 1; }
+
+    return (line_length + wrap_width - 1) / wrap_width;
+}
+
+// rows taken up by the line_length chars from char start of rn, which make up a whole line
+int64_t
+rope_wrap_rows_for_line(struct rope_t *rn, int64_t start, int64_t line_length, int64_t wrap_width)
+{
+    if (ROPE_WRAP_IS_PLAIN(wrap_width)) {
+        return rope_wrap_rows_for_line_length(line_length, wrap_width);
+    }
+
+    struct rope_iter_t iter;
+    if (line_length < WRAP_LINE_CACHE_THRESHOLD) {
+        rope_iter_init_at_char(&iter, rn, start);
+        return rope_wrap_walk(&iter, line_length, wrap_width, INT64_MAX, line_length, NULL);
+    }
+
+    // a long line ends at the first '\n' of its last leaf (or at the end of a leaf without one) unless it's
+    // entirely inside that leaf, so its count can be kept there and found again by every node above it
+    rope_iter_init_at_char(&iter, rn, start + line_length);
+    struct rope_t *leaf = iter.leaf;
+    int8_t slot = rope_wrap_cache_slot(leaf, wrap_width);
+    int8_t ends_line = leaf->total_line_break_weight > 0
+        ? rope_leaf_line_breaks(leaf)[0].char_offset == iter.char_offset
+        : iter.char_offset == leaf->total_char_weight;
+    if (slot < 0 || !ends_line) {
+        rope_iter_init_at_char(&iter, rn, start);
+        return rope_wrap_walk(&iter, line_length, wrap_width, INT64_MAX, line_length, NULL);
+    }
+
+    uint64_t hash = rope_hash_between(rn, start, start + line_length);
+    if (leaf->wrap_line_lengths[slot] == line_length && leaf->wrap_line_hashes[slot] == hash) {
+        return leaf->wrap_line_rows[slot];
+    }
+
+    rope_iter_init_at_char(&iter, rn, start);
+    int64_t rows = rope_wrap_walk(&iter, line_length, wrap_width, INT64_MAX, line_length, NULL);
+    leaf->wrap_line_rows[slot] = rows;
+    leaf->wrap_line_lengths[slot] = line_length;
+    leaf->wrap_line_hashes[slot] = hash;
+    return rows;
+}
+
+// goes through the rows that the line_length chars from iter wrap into, until it's been through max_rows of them
+// or the next one would start past char max_start of the line. returns how many it went through, and where in the
+// line the last of them starts in out_row_start (if given)
+int64_t
+rope_wrap_walk(struct rope_iter_t *iter, int64_t line_length, int64_t wrap_width,
+               int64_t max_rows, int64_t max_start, int64_t *out_row_start)
+{
+    struct rope_wrap_walk_t walk;
+    rope_wrap_walk_init(&walk, iter);
+    rope_wrap_walk_on(&walk, line_length, wrap_width, max_rows, max_start);
+
+    if (out_row_start != NULL) { *out_row_start = walk.row_start; }
+    return walk.rows;
+}
+
+// iter is at the start of the line, and is moved along it by the walk
+void
+rope_wrap_walk_init(struct rope_wrap_walk_t *walk, struct rope_iter_t *iter)
+{
+    walk->iter = iter;
+    walk->i = 0;
+    walk->rows = 1;
+    walk->row_start = 0;
+    walk->col = 0;
+    walk->break_at = 0;
+    walk->break_col = 0;
+}
+
+// rope_wrap_walk from wherever walk got to, which can be called again with a higher max_rows or max_start to go on.
+// a row breaks before the char that would take it past the width, or with ROPE_WRAP_WORDS after the last space or
+// tab before that if the rest still fits on the next row. a char wider than a whole row gets one to itself
+void
+rope_wrap_walk_on(struct rope_wrap_walk_t *walk, int64_t line_length, int64_t wrap_width,
+                  int64_t max_rows, int64_t max_start)
+{
+    int64_t width = wrap_width & ROPE_WRAP_WIDTH_MASK;
+
+    // every char is one column wide otherwise, which is worth not making a call per char for
+    int8_t display = (wrap_width & ROPE_WRAP_DISPLAY) != 0;
+
+    struct rope_iter_t *iter = walk->iter;
+    int64_t i = walk->i;
+    int64_t rows = walk->rows;
+    int64_t row_start = walk->row_start;
+    int64_t col = walk->col;
+
+    // 0 if there hasn't been a space or tab in the row yet. there are none between break_at and i, so when the
+    // row breaks there the next one has no break of its own yet either, and no tabs whose width would change by
+    // moving
+    int64_t break_at = walk->break_at;
+    int64_t break_col = walk->break_col;
+
+    for (; i < line_length && rows < max_rows; i++) {
+        int64_t char_width = display ? rope_wrap_char_width(iter, col, wrap_width) : 1;
+        if (col + char_width > width && col > 0) {
+            int64_t next_row_start = i;
+            int64_t next_col = 0;
+            if ((wrap_width & ROPE_WRAP_WORDS) && break_at > row_start) {
+                // a tab's width depends on where it ends up, so the fit is checked where it would be
+                int64_t carried_col = col - break_col;
+                if (carried_col + rope_wrap_char_width(iter, carried_col, wrap_width) <= width) {
+                    next_row_start = break_at;
+                    next_col = carried_col;
+                }
+            }
+            if (next_row_start > max_start) { break; }
+
+            rows += 1;
+            row_start = next_row_start;
+            col = next_col;
+            break_at = 0;
+            char_width = display ? rope_wrap_char_width(iter, col, wrap_width) : 1;
+        }
+        col += char_width;
+
+        char c = rope_iter_byte(iter);
+        if (c == ' ' || c == '\t') {
+            break_at = i + 1;
+            break_col = col;
+        }
+
+        rope_iter_next_char(iter);
+    }
+
+    walk->i = i;
+    walk->rows = rows;
+    walk->row_start = row_start;
+    walk->col = col;
+    walk->break_at = break_at;
+    walk->break_col = break_col;
+}
+
+// columns taken up by the char at iter when it's col columns into its row. without ROPE_WRAP_DISPLAY every char
+// takes up one. a tab that would go past the end of the row only fills it out
+int64_t
+rope_wrap_char_width(struct rope_iter_t *iter, int64_t col, int64_t wrap_width)
+{
+    if (!(wrap_width & ROPE_WRAP_DISPLAY)) { return 1; }
+
+    const char *c = rope_iter_char(iter);
+    if (*c == '\t') {
+        int64_t width = wrap_width & ROPE_WRAP_WIDTH_MASK;
+        int64_t tab_width = (wrap_width >> 24) & 31;
+        if (tab_width == 0) { tab_width = 8; }
+
+        int64_t char_width = tab_width - col % tab_width;
+        if (col < width && col + char_width > width) { char_width = width - col; }
+        return char_width;
+    }
+    if ((uint8_t) *c < 0x80) { return 1; }
+
+    return unicode_display_width(utf8_decode(c));
+}
+
+// where rn's row count for wrap_width is kept, or -1 if it hasn't been counted for it
+int8_t
+rope_wrap_cache_slot(struct rope_t *rn, int64_t wrap_width)
+{
+    for (int8_t n = 0; n < ROPE_WRAP_CACHE_SIZE; n++) {
+        if (rn->wrap_widths[n] == wrap_width) { return n; }
+    }
+
+    return -1;
+}
+
+// the least recently added width makes way for the new one
+void
+rope_wrap_cache_add(struct rope_t *rn, int64_t wrap_width, int64_t rows)
+{
+    for (int8_t n = ROPE_WRAP_CACHE_SIZE - 1; n > 0; n--) {
+        rn->wrap_widths[n] = rn->wrap_widths[n - 1];
+        rn->wrap_row_counts[n] = rn->wrap_row_counts[n - 1];
+        if (rn->is_leaf) {
+            rn->wrap_line_rows[n] = rn->wrap_line_rows[n - 1];
+            rn->wrap_line_lengths[n] = rn->wrap_line_lengths[n - 1];
+            rn->wrap_line_hashes[n] = rn->wrap_line_hashes[n - 1];
+        }
+    }
+
+    rn->wrap_widths[0] = (int32_t) wrap_width;
+    rn->wrap_row_counts[0] = rows;
+    if (rn->is_leaf) { rn->wrap_line_lengths[0] = -1; }
+}
+
+// rows taken up by the lines that start and end inside rn, counting them first if they haven't been
+int64_t
+rope_wrap_rows_inside(struct rope_t *rn, int64_t wrap_width)
+{
+    rope_update_line_summary(rn, wrap_width);
+    return rn->wrap_row_counts[rope_wrap_cache_slot(rn, wrap_width)];
+}
+
+void
+rope_leaf_update_line_summary(struct rope_t *leaf, int64_t wrap_width)
+{
+    int64_t line_break_count = leaf->total_line_break_weight;
+    struct rope_line_break_t *line_breaks = rope_leaf_line_breaks(leaf);
+
+    if (!leaf->has_line_summary) {
+        if (line_break_count == 0) {
+            leaf->first_line_length = leaf->total_char_weight;
+            leaf->last_line_length = leaf->total_char_weight;
+            leaf->longest_line_length = leaf->total_char_weight;
+        } else {
+            leaf->first_line_length = line_breaks[0].char_offset;
+            leaf->last_line_length = leaf->total_char_weight - line_breaks[line_break_count - 1].char_offset - 1;
+
+            int64_t longest = leaf->first_line_length;
+            if (leaf->last_line_length > longest) { longest = leaf->last_line_length; }
+            for (int64_t k = 1; k < line_break_count; k++) {
+                int64_t line_length = line_breaks[k].char_offset - line_breaks[k - 1].char_offset - 1;
+                if (line_length > longest) { longest = line_length; }
+            }
+            leaf->longest_line_length = longest;
+        }
+
+        memset(leaf->wrap_widths, 0, sizeof(leaf->wrap_widths));
+        leaf->has_line_summary = 1;
+    }
+
+    if (wrap_width > 0 && rope_wrap_cache_slot(leaf, wrap_width) < 0) {
+        int64_t rows = 0;
+        for (int64_t k = 1; k < line_break_count; k++) {
+            int64_t line_start = line_breaks[k - 1].char_offset + 1;
+            rows += rope_wrap_rows_for_line(leaf, line_start, line_breaks[k].char_offset - line_start, wrap_width);
+        }
+
+        rope_wrap_cache_add(leaf, wrap_width, rows);
+    }
+}
+
+// fills in the line summary of rn and anything under it that doesn't have one yet. with a wrap_width, the wrapped
+// row counts are brought up to date for it too. after an edit that's only the nodes the edit made, and a width
+// that was asked about recently is still there, so going back and forth between a few widths costs nothing.
+// nodes are shared between snapshots, so a child may since have had its count for this width pushed out by a rope
+// that doesn't include rn. rn's own counts are still right, but anything reading the children's has to go through
+// rope_wrap_rows_inside
+void
+rope_update_line_summary(struct rope_t *rn, int64_t wrap_width)
+{
+    if (rn == NULL) { return; }
+    if (rn->has_line_summary && (wrap_width <= 0 || rope_wrap_cache_slot(rn, wrap_width) >= 0)) { return; }
+
+    if (rn->is_leaf) {
+        rope_leaf_update_line_summary(rn, wrap_width);
+        return;
+    }
+
+    for (int8_t k = 0; k < rn->child_count; k++) {
+        rope_update_line_summary(rn->children[k], wrap_width);
+    }
+
+    struct rope_t *first = rn->children[0];
+    int64_t first_line_length = first->first_line_length;
+    int64_t last_line_length = first->last_line_length;
+    int64_t longest = first->longest_line_length;
+    int64_t rows = wrap_width > 0 ? rope_wrap_rows_inside(first, wrap_width) : 0;
+    int64_t line_breaks = first->total_line_break_weight;
+    int64_t child_start = first->total_char_weight;
+
+    for (int8_t k = 1; k < rn->child_count; k++) {
+        struct rope_t *child = rn->children[k];
+
+        // the line running across the seam between this child and the ones before it
+        int64_t joined = last_line_length + child->first_line_length;
+        if (joined > longest) { longest = joined; }
+        if (child->longest_line_length > longest) { longest = child->longest_line_length; }
+
+        if (line_breaks == 0) {
+            first_line_length = joined;
+        } else if (child->total_line_break_weight > 0 && wrap_width > 0) {
+            rows += rope_wrap_rows_for_line(rn, child_start - last_line_length, joined, wrap_width);
+        }
+
+        if (child->total_line_break_weight == 0) {
+            last_line_length = joined;
+        } else {
+            if (wrap_width > 0) { rows += rope_wrap_rows_inside(child, wrap_width); }
+            last_line_length = child->last_line_length;
+        }
+
+        line_breaks += child->total_line_break_weight;
+        child_start += child->total_char_weight;
+    }
+
+    rn->first_line_length = first_line_length;
+    rn->last_line_length = last_line_length;
+    rn->longest_line_length = longest;
+
+    if (!rn->has_line_summary) {
+        memset(rn->wrap_widths, 0, sizeof(rn->wrap_widths));
+    }
+    if (wrap_width > 0) {
+        rope_wrap_cache_add(rn, wrap_width, rows);
+    }
+
+    rn->has_line_summary = 1;
+}
+
+// the length in chars of the line, not counting its '\n'. -1 if there's no such line
+int64_t
+rope_line_length(struct rope_t *rn, int64_t line)
+{
+    if (rn == NULL || line < 0 || line > rn->total_line_break_weight) { return -1; }
+
+    int64_t start = rope_char_number_at_line(rn, line);
+    if (line == rn->total_line_break_weight) {
+        return rn->total_char_weight - start;
+    }
+
+    return rope_char_number_at_line(rn, line + 1) - 1 - start;
+}
+
+int64_t
+rope_longest_line_length(struct rope_t *rn)
+{
+    if (rn == NULL) { return -1; }
+
+    rope_update_line_summary(rn, 0);
+    return rn->longest_line_length;
+}
+
+int64_t
+rope_wrap_row_count(struct rope_t *rn, int64_t wrap_width)
+{
+    if (rn == NULL) { return 0; }
+
+    SE_ASSERT(wrap_width > 0);
+    int64_t rows = rope_wrap_rows_inside(rn, wrap_width)
+                   + rope_wrap_rows_for_line(rn, 0, rn->first_line_length, wrap_width);
+    if (rn->total_line_break_weight > 0) {
+        rows += rope_wrap_rows_for_line(rn, rn->total_char_weight - rn->last_line_length, rn->last_line_length,
+                                        wrap_width);
+    }
+    return rows;
+}
+
+// rows taken up by every line before the given one
+int64_t
+rope_wrap_rows_before_line(struct rope_t *rn, int64_t wrap_width, int64_t line)
+{
+    if (rn == NULL || line <= 0) { return 0; }
+    if (line > rn->total_line_break_weight) { return rope_wrap_row_count(rn, wrap_width); }
+
+    SE_ASSERT(wrap_width > 0);
+    rope_update_line_summary(rn, wrap_width);
+
+    struct rope_t *root = rn;
+    int64_t rows = 0;
+
+    // chars of the line that runs into the current node from the left, and where the node starts
+    int64_t carry = 0;
+    int64_t node_start = 0;
+
+    while (!rn->is_leaf) {
+        // skip the children that finish before the line does
+        int8_t k = 0;
+        while (rn->children[k]->total_line_break_weight < line) {
+            struct rope_t *child = rn->children[k];
+
+            if (child->total_line_break_weight == 0) {
+                carry += child->total_char_weight;
+            } else {
+                rows += rope_wrap_rows_inside(child, wrap_width)
+                        + rope_wrap_rows_for_line(root, node_start - carry, carry + child->first_line_length, wrap_width);
+                carry = child->last_line_length;
+            }
+
+            line -= child->total_line_break_weight;
+            node_start += child->total_char_weight;
+            k += 1;
+        }
+
+        rn = rn->children[k];
+    }
+
+    struct rope_line_break_t *line_breaks = rope_leaf_line_breaks(rn);
+    int64_t line_start = 0;
+    for (int64_t k = 0; k < line; k++) {
+        rows += rope_wrap_rows_for_line(root, node_start + line_start - carry,
+                                        carry + line_breaks[k].char_offset - line_start, wrap_width);
+        carry = 0;
+        line_start = line_breaks[k].char_offset + 1;
+    }
+
+    return rows;
+}
+
+// the line the given row is part of. rows past the end are part of the last line
+int64_t
+rope_line_for_wrap_row(struct rope_t *rn, int64_t wrap_width, int64_t row)
+{
+    if (rn == NULL || row <= 0) { return 0; }
+
+    SE_ASSERT(wrap_width > 0);
+    rope_update_line_summary(rn, wrap_width);
+
+    struct rope_t *root = rn;
+    int64_t rows = 0;
+    int64_t line = 0;
+    int64_t carry = 0;
+    int64_t node_start = 0;
+
+    while (!rn->is_leaf) {
+        // stop at the child the row's line finishes in, or the last one
+        int8_t k = 0;
+        while (k < rn->child_count - 1) {
+            struct rope_t *child = rn->children[k];
+
+            if (child->total_line_break_weight == 0) {
+                carry += child->total_char_weight;
+            } else {
+                int64_t rows_through_child = rows + rope_wrap_rows_inside(child, wrap_width)
+                                             + rope_wrap_rows_for_line(root, node_start - carry,
+                                                                       carry + child->first_line_length, wrap_width);
+                if (row < rows_through_child) { break; }
+
+                rows = rows_through_child;
+                carry = child->last_line_length;
+            }
+
+            line += child->total_line_break_weight;
+            node_start += child->total_char_weight;
+            k += 1;
+        }
+
+        rn = rn->children[k];
+    }
+
+    struct rope_line_break_t *line_breaks = rope_leaf_line_breaks(rn);
+    int64_t line_start = 0;
+    for (int64_t k = 0; k < rn->total_line_break_weight; k++) {
+        rows += rope_wrap_rows_for_line(root, node_start + line_start - carry,
+                                        carry + line_breaks[k].char_offset - line_start, wrap_width);
+        if (row < rows) { return line; }
+
+        line += 1;
+        carry = 0;
+        line_start = line_breaks[k].char_offset + 1;
+    }
+
+    return line;
+}
+
+// where in the line its given row starts, in chars. rows past its last one are its last one
+int64_t
+rope_wrap_row_start(struct rope_t *rn, int64_t wrap_width, int64_t line, int64_t row)
+{
+    int64_t line_length = rope_line_length(rn, line);
+    if (line_length < 0 || row <= 0) { return 0; }
+
+    return rope_wrap_row_start_in_line(rn, wrap_width, rope_char_number_at_line(rn, line), line_length, row);
+}
+
+// rope_wrap_row_start for the line of line_length chars from char line_start, which the caller already knows
+int64_t
+rope_wrap_row_start_in_line(struct rope_t *rn, int64_t wrap_width, int64_t line_start, int64_t line_length,
+                            int64_t row)
+{
+    if (row <= 0) { return 0; }
+
+    if (ROPE_WRAP_IS_PLAIN(wrap_width)) {
+        int64_t last_row = rope_wrap_rows_for_line_length(line_length, wrap_width) - 1;
+        return (row < last_row ? row : last_row) * wrap_width;
+    }
+
+    struct rope_iter_t iter;
+    rope_iter_init_at_char(&iter, rn, line_start);
+
+    int64_t row_start;
+    rope_wrap_walk(&iter, line_length, wrap_width, row + 1, line_length, &row_start);
+    return row_start;
+}
+
+// the row of the line that the char col chars into it is on
+int64_t
+rope_wrap_row_for_col(struct rope_t *rn, int64_t wrap_width, int64_t line, int64_t col)
+{
+    int64_t line_length = rope_line_length(rn, line);
+    if (line_length < 0 || col <= 0) { return 0; }
+
+    if (ROPE_WRAP_IS_PLAIN(wrap_width)) {
+        int64_t last_row = rope_wrap_rows_for_line_length(line_length, wrap_width) - 1;
+        return col / wrap_width < last_row ? col / wrap_width : last_row;
+    }
+
+    struct rope_iter_t iter;
+    rope_iter_init_at_line(&iter, rn, line);
+
+    return rope_wrap_walk(&iter, line_length, wrap_width, INT64_MAX, col, NULL) - 1;
+}
+
+// the column in its row that the char col chars into the line starts at
+int64_t
+rope_wrap_display_col(struct rope_t *rn, int64_t wrap_width, int64_t line, int64_t col)
+{
+    int64_t line_length = rope_line_length(rn, line);
+    if (line_length < 0 || col <= 0) { return 0; }
+    if (col > line_length) { col = line_length; }
+
+    int64_t row = rope_wrap_row_for_col(rn, wrap_width, line, col);
+    int64_t row_start = rope_wrap_row_start(rn, wrap_width, line, row);
+    if (!(wrap_width & ROPE_WRAP_DISPLAY)) { return col - row_start; }
+
+    struct rope_iter_t iter;
+    rope_iter_init_at_char(&iter, rn, rope_char_number_at_line(rn, line) + row_start);
+
+    int64_t display_col = 0;
+    for (int64_t i = row_start; i < col; i++) {
+        display_col += rope_wrap_char_width(&iter, display_col, wrap_width);
+        rope_iter_next_char(&iter);
+    }
+
+    return display_col;
+}
+
+// the char in the line that's at the given column of its given row. a column partway through a wide char or tab
+// is that char, and one past the end of the row is the row's last char, or the end of the line on its last row
+int64_t
+rope_wrap_char_for_display_col(struct rope_t *rn, int64_t wrap_width, int64_t line, int64_t row,
+                               int64_t display_col)
+{
+    int64_t line_length = rope_line_length(rn, line);
+    if (line_length < 0) { return 0; }
+
+    return rope_wrap_char_in_row(rn, wrap_width, rope_char_number_at_line(rn, line), line_length, row, display_col);
+}
+
+// rope_wrap_char_for_display_col for the line of line_length chars from char line_start
+int64_t
+rope_wrap_char_in_row(struct rope_t *rn, int64_t wrap_width, int64_t line_start, int64_t line_length, int64_t row,
+                      int64_t display_col)
+{
+    int64_t row_start = rope_wrap_row_start_in_line(rn, wrap_width, line_start, line_length, row);
+
+    // a row that isn't the last one ends just before the next one starts, so the char stays on it
+    int64_t row_end = line_length;
+    int64_t next_row_start = rope_wrap_row_start_in_line(rn, wrap_width, line_start, line_length, row + 1);
+    if (next_row_start > row_start) { row_end = next_row_start - 1; }
+
+    if (!(wrap_width & ROPE_WRAP_DISPLAY)) {
+        int64_t col = row_start + (display_col > 0 ? display_col : 0);
+        return col < row_end ? col : row_end;
+    }
+
+    struct rope_iter_t iter;
+    rope_iter_init_at_char(&iter, rn, line_start + row_start);
+
+    int64_t col = row_start;
+    int64_t row_col = 0;
+    while (col < row_end) {
+        int64_t char_width = rope_wrap_char_width(&iter, row_col, wrap_width);
+        if (row_col + char_width > display_col) { break; }
+
+        row_col += char_width;
+        col += 1;
+        rope_iter_next_char(&iter);
+    }
+
+    return col;
+}
+
+// the line the given row is part of, where it starts, how long it is and the rows before it, from one descent
+void
+rope_wrap_locate_row(struct rope_t *rn, int64_t wrap_width, int64_t row, struct rope_wrap_point_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    out->row = row;
+    if (rn == NULL) { return; }
+
+    SE_ASSERT(wrap_width > 0);
+    rope_update_line_summary(rn, wrap_width);
+
+    struct rope_t *root = rn;
+    int64_t rows = 0;
+    int64_t line = 0;
+    int64_t carry = 0;
+    int64_t node_start = 0;
+
+    // chars of the line that runs on past the end of the current node, up to its '\n' or the end of the text
+    int64_t tail = 0;
+
+    while (!rn->is_leaf) {
+        // stop at the child the row's line finishes in, or the last one (as in rope_line_for_wrap_row)
+        int8_t k = 0;
+        while (k < rn->child_count - 1) {
+            struct rope_t *child = rn->children[k];
+
+            if (child->total_line_break_weight == 0) {
+                carry += child->total_char_weight;
+            } else {
+                int64_t rows_through_child = rows + rope_wrap_rows_inside(child, wrap_width)
+                                             + rope_wrap_rows_for_line(root, node_start - carry,
+                                                                       carry + child->first_line_length, wrap_width);
+                if (row < rows_through_child) { break; }
+
+                rows = rows_through_child;
+                carry = child->last_line_length;
+            }
+
+            line += child->total_line_break_weight;
+            node_start += child->total_char_weight;
+            k += 1;
+        }
+
+        // the siblings after the child pick up where its last line leaves off, and the ones after this node do
+        // if none of them has a '\n'
+        int64_t after = 0;
+        int8_t ends_here = 0;
+        for (int8_t j = k + 1; j < rn->child_count && !ends_here; j++) {
+            struct rope_t *sibling = rn->children[j];
+            if (sibling->total_line_break_weight > 0) {
+                after += sibling->first_line_length;
+                ends_here = 1;
+            } else {
+                after += sibling->total_char_weight;
+            }
+        }
+        tail = ends_here ? after : after + tail;
+
+        rn = rn->children[k];
+    }
+
+    struct rope_line_break_t *line_breaks = rope_leaf_line_breaks(rn);
+    int64_t line_start = 0;
+    for (int64_t k = 0; k < rn->total_line_break_weight; k++) {
+        int64_t line_length = carry + line_breaks[k].char_offset - line_start;
+        int64_t line_rows = rope_wrap_rows_for_line(root, node_start + line_start - carry, line_length, wrap_width);
+        if (row < rows + line_rows) {
+            out->line = line;
+            out->line_start = node_start + line_start - carry;
+            out->line_length = line_length;
+            out->rows_before_line = rows;
+            return;
+        }
+
+        rows += line_rows;
+        line += 1;
+        carry = 0;
+        line_start = line_breaks[k].char_offset + 1;
+    }
+
+    out->line = line;
+    out->line_start = node_start + line_start - carry;
+    out->line_length = carry + rn->total_char_weight - line_start + tail;
+    out->rows_before_line = rows;
+}
+
+// the same as rope_wrap_locate_row for each of the sorted rows, walking on from one to the next
+void
+rope_wrap_locate_rows(struct rope_t *rn, int64_t wrap_width, const int64_t *rows, int64_t row_count,
+                      struct rope_wrap_point_t *out)
+{
+    if (row_count <= 0) { return; }
+
+    rope_wrap_locate_row(rn, wrap_width, rows[0], &out[0]);
+    struct rope_wrap_point_t point = out[0];
+
+    // kept at the start of the line after point's, once there's been a need for it
+    struct rope_iter_t iter;
+    int8_t has_iter = 0;
+
+    // rows taken up by point's line, counted once per line and only when it's needed. -1 until then
+    int64_t line_rows = -1;
+
+    for (int64_t n = 1; n < row_count; n++) {
+        SE_ASSERT(rows[n] >= rows[n - 1]);
+
+        if (rn == NULL || rows[n] - point.rows_before_line > WRAP_WALK_ROWS) {
+            rope_wrap_locate_row(rn, wrap_width, rows[n], &point);
+            has_iter = 0;
+            line_rows = -1;
+            out[n] = point;
+            continue;
+        }
+
+        if (line_rows < 0) {
+            line_rows = rope_wrap_rows_for_line(rn, point.line_start, point.line_length, wrap_width);
+        }
+        while (point.line < rn->total_line_break_weight && rows[n] >= point.rows_before_line + line_rows) {
+            point.rows_before_line += line_rows;
+            point.line += 1;
+            point.line_start += point.line_length + 1;
+
+            if (!has_iter) {
+                rope_iter_init_at_char(&iter, rn, point.line_start);
+                has_iter = 1;
+            }
+            if (rope_iter_next_line(&iter)) {
+                point.line_length = rope_iter_char_pos(&iter) - 1 - point.line_start;
+            } else {
+                point.line_length = rn->total_char_weight - point.line_start;
+            }
+
+            line_rows = rope_wrap_rows_for_line(rn, point.line_start, point.line_length, wrap_width);
+        }
+
+        point.row = rows[n];
+        out[n] = point;
+    }
+}
+
+// the char (from the start of the rope) at the given column of point's row, clamped to the row as in
+// rope_wrap_char_for_display_col
+int64_t
+rope_wrap_point_char(struct rope_t *rn, int64_t wrap_width, const struct rope_wrap_point_t *point,
+                     int64_t display_col)
+{
+    if (rn == NULL) { return 0; }
+
+    int64_t row = point->row - point->rows_before_line;
+    return point->line_start + rope_wrap_char_in_row(rn, wrap_width, point->line_start, point->line_length, row,
+                                                     display_col);
+}
+
+int64_t
+rope_get_rows(struct rope_t *rn, int64_t wrap_width, int64_t start_row, int64_t row_count, struct rope_rows_t *out)
+{
+    out->row_count = 0;
+    out->fragment_count = 0;
+    if (rn == NULL || start_row < 0) { return 0; }
+    if (row_count > out->row_capacity) { row_count = out->row_capacity; }
+
+    struct rope_wrap_point_t point;
+    if (wrap_width > 0) {
+        rope_wrap_locate_row(rn, wrap_width, start_row, &point);
+    } else {
+        if (start_row > rn->total_line_break_weight) { return 0; }
+
+        point.row = start_row;
+        point.line = start_row;
+        point.line_start = rope_char_number_at_line(rn, start_row);
+        point.line_length = rope_line_length(rn, start_row);
+        point.rows_before_line = start_row;
+    }
+
+    // at the start of the row, and at the start of the next line (or the end of the text on the last one).
+    // both only ever go forward, and lines are found by their '\n's rather than by seeking to chars
+    struct rope_iter_t iter;
+    rope_iter_init_at_char(&iter, rn, point.line_start);
+    struct rope_iter_t next_line = iter;
+    int64_t line_end_byte = rn->total_byte_weight;
+    if (rope_iter_next_line(&next_line)) { line_end_byte = rope_iter_byte_pos(&next_line) - 1; }
+
+    // rows that aren't plain are found by walking the line, which is done once for all of its rows rather than
+    // from its start for each
+    int8_t walks = wrap_width > 0 && !ROPE_WRAP_IS_PLAIN(wrap_width);
+    struct rope_iter_t walk_iter = iter;
+    struct rope_wrap_walk_t walk;
+    rope_wrap_walk_init(&walk, &walk_iter);
+
+    int64_t row_start = point.line_start;
+    if (wrap_width > 0 && point.row > point.rows_before_line) {
+        int64_t row_in_line = point.row - point.rows_before_line;
+        if (walks) {
+            rope_wrap_walk_on(&walk, point.line_length, wrap_width, row_in_line + 1, point.line_length);
+            row_start += walk.row_start;
+        } else {
+            row_start += rope_wrap_row_start_in_line(rn, wrap_width, point.line_start, point.line_length,
+                                                     row_in_line);
+        }
+        rope_iter_seek_char(&iter, row_start);
+    }
+
+    // rows taken up by point's line, counted once it's reached. -1 until then
+    int64_t line_rows = -1;
+
+    while (out->row_count < row_count) {
+        if (line_rows < 0) {
+            line_rows = 1;
+            if (wrap_width > 0) {
+                line_rows = rope_wrap_rows_for_line(rn, point.line_start, point.line_length, wrap_width);
+            }
+        }
+
+        // rows past the last line's last one are past the end of the text
+        int64_t row_in_line = point.row - point.rows_before_line;
+        if (row_in_line >= line_rows) { break; }
+
+        // the line's last row goes up to its '\n', the others up to where the next one starts
+        int64_t row_end = point.line_start + point.line_length;
+        int64_t row_end_byte = line_end_byte;
+        struct rope_iter_t next_row;
+        if (row_in_line + 1 < line_rows) {
+            if (walks) {
+                rope_wrap_walk_on(&walk, point.line_length, wrap_width, row_in_line + 2, point.line_length);
+                row_end = point.line_start + walk.row_start;
+            } else {
+                row_end = point.line_start + rope_wrap_row_start_in_line(rn, wrap_width, point.line_start,
+                                                                         point.line_length, row_in_line + 1);
+            }
+            next_row = iter;
+            rope_iter_seek_char(&next_row, row_end);
+            row_end_byte = rope_iter_byte_pos(&next_row);
+        }
+
+        if (!rope_get_row_fragments(&iter, point.line, row_start, row_end, row_end_byte, out)) { break; }
+
+        point.row += 1;
+        if (row_in_line + 1 < line_rows) {
+            iter = next_row;
+            row_start = row_end;
+        } else if (point.line < rn->total_line_break_weight) {
+            point.rows_before_line += line_rows;
+            point.line += 1;
+            point.line_start += point.line_length + 1;
+            line_rows = -1;
+
+            iter = next_line;
+            row_start = point.line_start;
+            if (walks) {
+                walk_iter = iter;
+                rope_wrap_walk_init(&walk, &walk_iter);
+            }
+            if (rope_iter_next_line(&next_line)) {
+                line_end_byte = rope_iter_byte_pos(&next_line) - 1;
+                point.line_length = rope_iter_char_pos(&next_line) - 1 - point.line_start;
+            } else {
+                line_end_byte = rn->total_byte_weight;
+                point.line_length = rn->total_char_weight - point.line_start;
+            }
+        }
+    }
+
+    return out->row_count;
+}
+
+// adds the row of chars [row_start, row_end) to out, which are the bytes from iter to row_end_byte. returns 0,
+// adding nothing, if there isn't room for it
+int8_t
+rope_get_row_fragments(struct rope_iter_t *iter, int64_t line, int64_t row_start, int64_t row_end,
+                       int64_t row_end_byte, struct rope_rows_t *out)
+{
+    struct rope_iter_t fragment_iter = *iter;
+    int64_t remaining = row_end_byte - rope_iter_byte_pos(iter);
+
+    int64_t fragment_count = out->fragment_count;
+    while (remaining > 0) {
+        const char *bytes;
+        int64_t length;
+        rope_iter_chunk(&fragment_iter, &bytes, &length);
+        if (length > remaining) { length = remaining; }
+
+        if (length > 0) {
+            if (fragment_count == out->fragment_capacity) { return 0; }
+
+            struct rope_fragment_t *fragment = &out->fragments[fragment_count];
+            fragment->leaf = fragment_iter.leaf;
+            fragment->bytes = bytes;
+            fragment->length = length;
+
+            fragment_count += 1;
+            remaining -= length;
+        }
+
+        if (remaining > 0 && !rope_iter_next_chunk(&fragment_iter)) { break; }
+    }
+
+    struct rope_row_t *row = &out->rows[out->row_count];
+    row->line = line;
+    row->char_start = row_start;
+    row->char_length = row_end - row_start;
+    row->fragment_start = out->fragment_count;
+    row->fragment_count = fragment_count - out->fragment_count;
+
+    out->fragment_count = fragment_count;
+    out->row_count += 1;
+    return 1;
+}
+
+// iter
+void
+rope_iter_init_at_byte(struct rope_iter_t *iter, struct rope_t *rn, int64_t i)
+{
+    if (i < 0) { i = 0; }
+    if (i > rn->total_byte_weight) { i = rn->total_byte_weight; }
+
+    rope_iter_init_at_root(iter, rn);
+    rope_iter_descend_to_byte(iter, i);
+}
+
+void
+rope_iter_init_at_char(struct rope_iter_t *iter, struct rope_t *rn, int64_t i)
+{
+    if (i < 0) { i = 0; }
+    if (i > rn->total_char_weight) { i = rn->total_char_weight; }
+
+    rope_iter_init_at_root(iter, rn);
+    rope_iter_descend_to_char(iter, i);
+}
+
+void
+rope_iter_init_at_line(struct rope_iter_t *iter, struct rope_t *rn, int64_t line)
+{
+    rope_iter_init_at_root(iter, rn);
+    rope_iter_seek_line(iter, line);
+}
+
+void
+rope_iter_init_at_root(struct rope_iter_t *iter, struct rope_t *rn)
+{
+    iter->depth = 0;
+    iter->path[0] = rn;
+    iter->leaf_byte_start = 0;
+    iter->leaf_char_start = 0;
+    iter->leaf_line_break_start = 0;
+}
+
+// the descents start from path[depth], with leaf_*_start holding where that node starts, and go down to
+// the leaf holding the i-th byte / char / line start of it
+void
+rope_iter_descend_to_byte(struct rope_iter_t *iter, int64_t i)
+{
+    struct rope_t *rn = iter->path[iter->depth];
+
+    while (!rn->is_leaf) {
+        int8_t k = rope_child_for_byte(rn, i);
+        if (k > 0) { i -= rn->byte_prefix[k - 1]; }
+        rn = rope_iter_push(iter, k);
+    }
+
+    iter->leaf = rn;
+    iter->byte_offset = i;
+    iter->char_offset = rope_leaf_char_for_byte_offset(rn, i);
+
+    rope_iter_skip_leaf_end(iter);
+}
+
+void
+rope_iter_descend_to_char(struct rope_iter_t *iter, int64_t i)
+{
+    struct rope_t *rn = iter->path[iter->depth];
+
+    while (!rn->is_leaf) {
+        int8_t k = rope_child_for_char(rn, i);
+        if (k > 0) { i -= rn->char_prefix[k - 1]; }
+        rn = rope_iter_push(iter, k);
+    }
+
+    // the leaf's checkpoints don't reach its very end
+    iter->leaf = rn;
+    iter->byte_offset = i < rn->total_char_weight ? rope_leaf_byte_offset_for_char(rn, i) : rn->total_byte_weight;
+    iter->char_offset = i;
+
+    rope_iter_skip_leaf_end(iter);
+}
+
+// line is at least 1 and no more than the node's line breaks, and the line starts just after its break
+void
+rope_iter_descend_to_line(struct rope_iter_t *iter, int64_t line)
+{
+    struct rope_t *rn = iter->path[iter->depth];
+
+    while (!rn->is_leaf) {
+        int8_t k = 0;
+        while (k < rn->child_count - 1 && rn->line_break_prefix[k] < line) {
+            k += 1;
+        }
+        if (k > 0) { line -= rn->line_break_prefix[k - 1]; }
+        rn = rope_iter_push(iter, k);
+    }
+
+    struct rope_line_break_t line_break = rope_leaf_line_breaks(rn)[line - 1];
+
+    iter->leaf = rn;
+    iter->byte_offset = line_break.byte_offset + 1;
+    iter->char_offset = line_break.char_offset + 1;
+
+    rope_iter_skip_leaf_end(iter);
+}
+
+// moves down to the k-th child of path[depth] and returns it
+struct rope_t *
+rope_iter_push(struct rope_iter_t *iter, int8_t k)
+{
+    struct rope_t *rn = iter->path[iter->depth];
+    if (k > 0) {
+        iter->leaf_byte_start += rn->byte_prefix[k - 1];
+        iter->leaf_char_start += rn->char_prefix[k - 1];
+        iter->leaf_line_break_start += rn->line_break_prefix[k - 1];
+    }
+
+    iter->child_index[iter->depth] = k;
+    iter->depth += 1;
+    iter->path[iter->depth] = rn->children[k];
+
+    return rn->children[k];
+}
+
+// moves up to the parent of path[depth], leaving leaf_*_start holding where the parent starts
+void
+rope_iter_pop(struct rope_iter_t *iter)
+{
+    iter->depth -= 1;
+
+    int8_t k = iter->child_index[iter->depth];
+    if (k > 0) {
+        struct rope_t *rn = iter->path[iter->depth];
+        iter->leaf_byte_start -= rn->byte_prefix[k - 1];
+        iter->leaf_char_start -= rn->char_prefix[k - 1];
+        iter->leaf_line_break_start -= rn->line_break_prefix[k - 1];
+    }
+}
+
+void
+rope_iter_seek_char(struct rope_iter_t *iter, int64_t i)
+{
+    struct rope_t *root = iter->path[0];
+    if (i < 0) { i = 0; }
+    if (i > root->total_char_weight) { i = root->total_char_weight; }
+
+    // only climb as far as the first node holding i. the very end of the rope is only held by the root
+    while (iter->depth > 0
+           && (i < iter->leaf_char_start
+               || i >= iter->leaf_char_start + iter->path[iter->depth]->total_char_weight)) {
+        rope_iter_pop(iter);
+    }
+
+    rope_iter_descend_to_char(iter, i - iter->leaf_char_start);
+}
+
+void
+rope_iter_seek_line(struct rope_iter_t *iter, int64_t line)
+{
+    struct rope_t *root = iter->path[0];
+    if (line <= 0) {
+        rope_iter_seek_char(iter, 0);
+        return;
+    }
+    if (line > root->total_line_break_weight) {
+        rope_iter_seek_char(iter, root->total_char_weight);
+        return;
+    }
+
+    // the node holding the line's break, which the line starts just after
+    while (iter->depth > 0
+           && (line <= iter->leaf_line_break_start
+               || line > iter->leaf_line_break_start + iter->path[iter->depth]->total_line_break_weight)) {
+        rope_iter_pop(iter);
+    }
+
+    rope_iter_descend_to_line(iter, line - iter->leaf_line_break_start);
+}
+
+// keeps the iterator off the very end of a leaf unless it's the last one,
+// so the byte under it always lives in iter->leaf
+void
+rope_iter_skip_leaf_end(struct rope_iter_t *iter)
+{
+    if (iter->byte_offset == iter->leaf->total_byte_weight) {
+        rope_iter_next_chunk(iter);
+    }
+}
+
+int8_t
+rope_iter_next_chunk(struct rope_iter_t *iter)
+{
+    int8_t d = (int8_t) (iter->depth - 1);
+    while (d >= 0 && iter->child_index[d] == iter->path[d]->child_count - 1) {
+        d -= 1;
+    }
+    if (d < 0) { return 0; }
+
+    iter->leaf_byte_start += iter->leaf->total_byte_weight;
+    iter->leaf_char_start += iter->leaf->total_char_weight;
+    iter->leaf_line_break_start += iter->leaf->total_line_break_weight;
+
+    iter->child_index[d] += 1;
+    struct rope_t *rn = iter->path[d]->children[iter->child_index[d]];
+
+    for (d += 1; d < iter->depth; d++) {
+        iter->path[d] = rn;
+        iter->child_index[d] = 0;
+        rn = rn->children[0];
+    }
+    iter->path[d] = rn;
+
+    iter->leaf = rn;
+    iter->byte_offset = 0;
+    iter->char_offset = 0;
+    return 1;
+}
+
+int8_t
+rope_iter_prev_chunk(struct rope_iter_t *iter)
+{
+    int8_t d = (int8_t) (iter->depth - 1);
+    while (d >= 0 && iter->child_index[d] == 0) {
+        d -= 1;
+    }
+    if (d < 0) { return 0; }
+
+    iter->child_index[d] -= 1;
+    struct rope_t *rn = iter->path[d]->children[iter->child_index[d]];
+
+    for (d += 1; d < iter->depth; d++) {
+        iter->path[d] = rn;
+        iter->child_index[d] = (int8_t) (rn->child_count - 1);
+        rn = rn->children[rn->child_count - 1];
+    }
+    iter->path[d] = rn;
+
+    iter->leaf_byte_start -= rn->total_byte_weight;
+    iter->leaf_char_start -= rn->total_char_weight;
+    iter->leaf_line_break_start -= rn->total_line_break_weight;
+
+    // unlike moving forward, this lands at the end of the leaf, ready to step back into it
+    iter->leaf = rn;
+    iter->byte_offset = rn->total_byte_weight;
+    iter->char_offset = rn->total_char_weight;
+    return 1;
+}
+
+void
+rope_iter_chunk(struct rope_iter_t *iter, const char **out_bytes, int64_t *out_length)
+{
+    *out_bytes = rope_leaf_bytes(iter->leaf) + iter->byte_offset;
+    *out_length = iter->leaf->total_byte_weight - iter->byte_offset;
+}
+
+int8_t
+rope_iter_at_end(struct rope_iter_t *iter)
+{
+    return iter->byte_offset >= iter->leaf->total_byte_weight;
+}
+
+char
+rope_iter_byte(struct rope_iter_t *iter)
+{
+    if (rope_iter_at_end(iter)) { return -1; }
+
+    return *(rope_leaf_bytes(iter->leaf) + iter->byte_offset);
+}
+
+const char *
+rope_iter_char(struct rope_iter_t *iter)
+{
+    if (rope_iter_at_end(iter)) { return NULL; }
+
+    return rope_leaf_bytes(iter->leaf) + iter->byte_offset;
+}
+
+int64_t
+rope_iter_byte_pos(struct rope_iter_t *iter)
+{
+    return iter->leaf_byte_start + iter->byte_offset;
+}
+
+int64_t
+rope_iter_char_pos(struct rope_iter_t *iter)
+{
+    return iter->leaf_char_start + iter->char_offset;
+}
+
+int8_t
+rope_iter_next_byte(struct rope_iter_t *iter)
+{
+    if (rope_iter_at_end(iter)) { return 0; }
+
+    // chars are counted by their first byte, so stepping off one moves to the next char
+    char c = *(rope_leaf_bytes(iter->leaf) + iter->byte_offset);
+    if ((c & 0xC0) != 0x80) { iter->char_offset += 1; }
+
+    iter->byte_offset += 1;
+    rope_iter_skip_leaf_end(iter);
+    return 1;
+}
+
+int8_t
+rope_iter_prev_byte(struct rope_iter_t *iter)
+{
+    if (iter->byte_offset == 0 && !rope_iter_prev_chunk(iter)) { return 0; }
+
+    iter->byte_offset -= 1;
+
+    char c = *(rope_leaf_bytes(iter->leaf) + iter->byte_offset);
+    if ((c & 0xC0) != 0x80) { iter->char_offset -= 1; }
+    return 1;
+}
+
+int8_t
+rope_iter_next_char(struct rope_iter_t *iter)
+{
+    if (rope_iter_at_end(iter)) { return 0; }
+
+    iter->byte_offset += bytes_in_codepoint_utf8(*(rope_leaf_bytes(iter->leaf) + iter->byte_offset));
+    if (iter->byte_offset > iter->leaf->total_byte_weight) {
+        iter->byte_offset = iter->leaf->total_byte_weight;
+    }
+    iter->char_offset += 1;
+
+    rope_iter_skip_leaf_end(iter);
+    return 1;
+}
+
+int8_t
+rope_iter_prev_char(struct rope_iter_t *iter)
+{
+    if (iter->byte_offset == 0 && !rope_iter_prev_chunk(iter)) { return 0; }
+
+    // leaves always split on a codepoint boundary, so the previous char is entirely in this leaf
+    const char *bytes = rope_leaf_bytes(iter->leaf);
+    do {
+        iter->byte_offset -= 1;
+    } while (iter->byte_offset > 0 && (*(bytes + iter->byte_offset) & 0xC0) == 0x80);
+
+    iter->char_offset -= 1;
+    return 1;
+}
+
+int8_t
+rope_iter_next_line(struct rope_iter_t *iter)
+{
+    struct rope_iter_t start = *iter;
+
+    while (1) {
+        const char *bytes;
+        int64_t length;
+        rope_iter_chunk(iter, &bytes, &length);
+
+        const char *line_break = memchr(bytes, '\n', (size_t) length);
+        if (line_break != NULL) {
+            iter->byte_offset += (int64_t) (line_break - bytes) + 1;
+            iter->char_offset = rope_leaf_char_for_byte_offset(iter->leaf, iter->byte_offset);
+
+            rope_iter_skip_leaf_end(iter);
+            return 1;
+        }
+
+        if (!rope_iter_next_chunk(iter)) {
+            // already on the last line
+            *iter = start;
+            return 0;
+        }
+    }
+}
+
+void
+rope_iter_line_start(struct rope_iter_t *iter)
+{
+    while (1) {
+        const char *bytes = rope_leaf_bytes(iter->leaf);
+
+        int64_t i = iter->byte_offset;
+        while (i > 0 && *(bytes + i - 1) != '\n') {
+            i -= 1;
+        }
+
+        if (i > 0 || !rope_iter_prev_chunk(iter)) {
+            iter->byte_offset = i;
+            iter->char_offset = rope_leaf_char_for_byte_offset(iter->leaf, i);
+
+            rope_iter_skip_leaf_end(iter);
+            return;
+        }
+    }
+}
+
+int8_t
+rope_iter_prev_line(struct rope_iter_t *iter)
+{
+    struct rope_iter_t start = *iter;
+
+    rope_iter_line_start(iter);
+
+    // step back over the '\n' that ends the previous line, then to that line's start
+    if (!rope_iter_prev_byte(iter)) {
+        // already on the first line
+        *iter = start;
+        return 0;
+    }
+
+    rope_iter_line_start(iter);
+    return 1;
+}
+
+int64_t
+rope_iter_line_number(struct rope_iter_t *iter)
+{
+    return iter->leaf_line_break_start + rope_leaf_line_breaks_before_byte(iter->leaf, iter->byte_offset);
+}
+
+// finger
+void
+rope_finger_reset(struct rope_finger_t *finger)
+{
+    finger->root = NULL;
+}
+
+struct rope_iter_t *
+rope_finger_at_char(struct rope_finger_t *finger, struct rope_t *rn, int64_t i)
+{
+    if (finger->root != rn) {
+        rope_iter_init_at_char(&finger->iter, rn, i);
+        finger->root = rn;
+    } else {
+        rope_iter_seek_char(&finger->iter, i);
+    }
+
+    return &finger->iter;
+}
+
+struct rope_iter_t *
+rope_finger_at_line(struct rope_finger_t *finger, struct rope_t *rn, int64_t line)
+{
+    if (finger->root != rn) {
+        rope_iter_init_at_root(&finger->iter, rn);
+        finger->root = rn;
+    }
+    rope_iter_seek_line(&finger->iter, line);
+
+    return &finger->iter;
+}
+
+const char *
+rope_finger_char_at(struct rope_finger_t *finger, struct rope_t *rn, int64_t i)
+{
+    if (rn == NULL || i < 0 || i >= rn->total_char_weight) { return NULL; }
+
+    return rope_iter_char(rope_finger_at_char(finger, rn, i));
+}
+
+int64_t
+rope_finger_line_for_char(struct rope_finger_t *finger, struct rope_t *rn, int64_t char_pos)
+{
+    if (rn == NULL) { return 0; }
+
+    return rope_iter_line_number(rope_finger_at_char(finger, rn, char_pos));
+}
+
+int64_t
+rope_finger_char_number_at_line(struct rope_finger_t *finger, struct rope_t *rn, int64_t line)
+{
+    if (rn == NULL || line <= 0) { return 0; }
+
+    // same as rope_char_number_at_line, which puts lines past the end one past the last char
+    if (line > rn->total_line_break_weight) { return rn->total_char_weight + 1; }
+
+    return rope_iter_char_pos(rope_finger_at_line(finger, rn, line));
+}
+
+int64_t
+rope_finger_line_length(struct rope_finger_t *finger, struct rope_t *rn, int64_t line)
+{
+    if (rn == NULL || line < 0 || line > rn->total_line_break_weight) { return -1; }
+
+    int64_t start = rope_finger_char_number_at_line(finger, rn, line);
+    if (line == rn->total_line_break_weight) {
+        return rn->total_char_weight - start;
+    }
+
+    // leaves the finger at the start of the next line, where drawing or moving down looks next
+    return rope_finger_char_number_at_line(finger, rn, line + 1) - 1 - start;
+}
+
+struct rope_t *
+rope_insert(struct rope_t *rn, int64_t i, const char *text)
+{
+    struct rope_t *split_left;
+    struct rope_t *split_right;
+    rope_split_at_char(rn, i, &split_left, &split_right);
+
+    // the inserted text comes out as its own balanced subtree, which the concats splice in whole
+    struct rope_t *insert = rope_leaf_init(text);
+
+    struct rope_t *combined_left = rope_concat(split_left, insert);
+    struct rope_t *cat = rope_concat(combined_left, split_right);
+
+    return cat;
+}
+
+struct rope_t *
+rope_delete(struct rope_t *rn, int64_t start, int64_t end)
+{
+    if (rope_total_char_length(rn) == 1) {
+        return rope_leaf_init("");
+    }
+
+    struct rope_t *split_end_left;
+    struct rope_t *split_end_right;
+
+    rope_split_at_char(rn, end, &split_end_left, &split_end_right);
+
+    struct rope_t *split_start_left;
+    struct rope_t *split_start_right;
+
+    rope_split_at_char(split_end_left, start, &split_start_left, &split_start_right);
+
+    struct rope_t *result = rope_concat(split_start_left, split_end_right);
+
+    rope_free(split_end_left);
+    rope_free(split_start_right);
+
+    return result;
+}
+
+struct rope_t *
+rope_slice(struct rope_t *rn, int64_t start, int64_t end)
+{
+    if (start < 0) { start = 0; }
+    if (end > rope_total_char_length(rn)) { end = rope_total_char_length(rn); }
+    if (end <= start) { return rope_leaf_init(""); }
+
+    struct rope_t *split_end_left;
+    struct rope_t *split_end_right;
+
+    rope_split_at_char(rn, end, &split_end_left, &split_end_right);
+
+    struct rope_t *split_start_left;
+    struct rope_t *split_start_right;
+
+    rope_split_at_char(split_end_left, start, &split_start_left, &split_start_right);
+
+    rope_free(split_end_left);
+    rope_free(split_end_right);
+    rope_free(split_start_left);
+
+    return split_start_right;
+}
+
+struct rope_t *
+rope_insert_rope(struct rope_t *rn, int64_t i, struct rope_t *insert)
+{
+    struct rope_t *split_left;
+    struct rope_t *split_right;
+    rope_split_at_char(rn, i, &split_left, &split_right);
+
+    // the concats consume what they're given, so they get a copy of insert's root and insert is left as it was
+    struct rope_t *combined_left = rope_concat(split_left, rope_shallow_copy(insert));
+    struct rope_t *cat = rope_concat(combined_left, split_right);
+
+    return cat;
+}
+
+void
+rope_collect_leaf_nodes(struct rope_t *rn, struct vector_t *leaves)
+{
+    if (rn->is_leaf) {
+        vector_append(leaves, &rn);
+        return;
+    }
+
+    for (int8_t k = 0; k < rn->child_count; k++) {
+        rope_collect_leaf_nodes(rn->children[k], leaves);
+    }
+}
+
+// appends leaves to packed with runs of small ones folded together, the way rope_concat would have if it had seen
+// them side by side. leaves that are left alone are appended as they are, and empty ones are dropped
+void
+rope_pack_leaves(struct vector_t *leaves, struct vector_t *packed)
+{
+    struct rope_t *pending = NULL;
+
+    for (int64_t i = 0; i < leaves->length; i++) {
+        struct rope_t *leaf = (struct rope_t *) vector_at_deref(leaves, i);
+        if (leaf->total_byte_weight == 0) { continue; }
+
+        if (pending != NULL) {
+            int8_t either_small = pending->total_byte_weight < MERGE_THRESHOLD || leaf->total_byte_weight < MERGE_THRESHOLD;
+            if (either_small && pending->total_byte_weight + leaf->total_byte_weight < COPY_THRESHOLD) {
+                pending = rope_leaf_init_concat(pending, leaf);
+                continue;
+            }
+
+            vector_append(packed, &pending);
+        }
+        pending = leaf;
+    }
+    if (pending != NULL) {
+        vector_append(packed, &pending);
+    }
+}
+
+struct rope_t *
+rope_compact_step(struct rope_t *rn, int64_t *position, int64_t leaf_budget)
+{
+    if (rn == NULL || *position >= rn->total_char_weight) {
+        *position = rope_total_char_length(rn);
+        return NULL;
+    }
+
+    // the run starts at the start of the leaf holding *position
+    struct rope_iter_t iter;
+    rope_iter_init_at_char(&iter, rn, *position);
+    int64_t start = iter.leaf_char_start;
+
+    struct vector_t *leaves = vector_init(16, sizeof(struct rope_t *));
+    do {
+        vector_append(leaves, &iter.leaf);
+    } while (leaves->length < leaf_budget && rope_iter_next_chunk(&iter));
+
+    int64_t end = iter.leaf_char_start + iter.leaf->total_char_weight;
+    *position = end;
+
+    struct vector_t *packed = vector_init(leaves->length, sizeof(struct rope_t *));
+    rope_pack_leaves(leaves, packed);
+
+    if (packed->length == leaves->length) {
+        // nothing in the run was small enough to fold into a neighbour
+        vector_free(packed);
+        vector_free(leaves);
+        return NULL;
+    }
+
+    struct rope_t *run = rope_build_from_leaves(packed);
+    if (run->rc > 0) {
+        // a single leaf that still belongs to rn
+        run = rope_shallow_copy(run);
+    }
+
+    struct rope_t *split_end_left;
+    struct rope_t *split_end_right;
+    rope_split_at_char(rn, end, &split_end_left, &split_end_right);
+
+    struct rope_t *split_start_left;
+    struct rope_t *split_start_right;
+    rope_split_at_char(split_end_left, start, &split_start_left, &split_start_right);
+
+    rope_free(split_end_left);
+    rope_free(split_start_right);
+
+    struct rope_t *compacted = rope_concat(rope_concat(split_start_left, run), split_end_right);
+
+    vector_free(packed);
+    vector_free(leaves);
+    return compacted;
+}
+
+struct rope_t *
+rope_balance(struct rope_t *rn)
+{
+    if (rn == NULL) { return NULL; }
+    if (rn->is_leaf) { return rope_shallow_copy(rn); }
+
+    struct vector_t *leaves = vector_init(16, sizeof(struct rope_t *));
+    rope_collect_leaf_nodes(rn, leaves);
+
+    // fold runs of small leaves together, everything else is shared with rn as it is.
+    // every leaf here has a parent, so rope_leaf_init_concat won't free any of them
+    struct vector_t *packed = vector_init(leaves->length, sizeof(struct rope_t *));
+    rope_pack_leaves(leaves, packed);
+
+    struct rope_t *balanced = rope_build_from_leaves(packed);
+    if (balanced->rc > 0) {
+        // a single leaf that still belongs to rn
+        balanced = rope_shallow_copy(balanced);
+    }
+
+    vector_free(packed);
+    vector_free(leaves);
+    return balanced;
+}
+
+int64_t
+rope_height(struct rope_t *rn)
+{
+    if (rn == NULL) { return 0; }
+
+    return rn->height;
+}
+
+// hashes
+// hashes are polynomials in the bytes, mod the mersenne prime 2^61 - 1, so the hash of two pieces of text
+// joined together comes straight from theirs: hash(a b) = hash(a) * base^length(b) + hash(b)
+uint64_t
+rope_hash_reduce(unsigned __int128 x)
+{
+    // 2^61 is 1 mod the prime, so the bits above 61 fold back onto the bottom ones. x is under 2^124
+    uint64_t r = (uint64_t) (x & ROPE_HASH_PRIME) + (uint64_t) (x >> 61);
+    r = (r & ROPE_HASH_PRIME) + (r >> 61);
+    return r >= ROPE_HASH_PRIME ? r - ROPE_HASH_PRIME : r;
+}
+
+uint64_t
+rope_hash_join(uint64_t left_hash, uint64_t right_hash, int64_t right_byte_length)
+{
+    return rope_hash_reduce((unsigned __int128) left_hash * rope_hash_power(right_byte_length) + right_hash);
+}
+
+// base^n
+uint64_t
+rope_hash_power(int64_t n)
+{
+    uint64_t power = 1;
+    uint64_t square = rope_hash_powers[1];
+    while (n > 0) {
+        if (n & 1) { power = rope_hash_reduce((unsigned __int128) power * square); }
+        square = rope_hash_reduce((unsigned __int128) square * square);
+        n >>= 1;
+    }
+
+    return power;
+}
+
+// hash is the hash of whatever comes before bytes
+uint64_t
+rope_hash_bytes(uint64_t hash, const char *bytes, int64_t byte_length)
+{
+    const uint8_t *b = (const uint8_t *) bytes;
+    int64_t i = 0;
+
+    // eight bytes a step, so the multiply each step has to wait for is once per eight bytes, not once per byte
+    for (; i + 8 <= byte_length; i += 8) {
+        unsigned __int128 sum = (unsigned __int128) hash * rope_hash_powers[8];
+        for (int64_t j = 0; j < 8; j++) {
+            sum += (unsigned __int128) b[i + j] * rope_hash_powers[7 - j];
+        }
+        hash = rope_hash_reduce(sum);
+    }
+
+    for (; i < byte_length; i++) {
+        hash = rope_hash_reduce((unsigned __int128) hash * rope_hash_powers[1] + b[i]);
+    }
+
+    return hash;
+}
+
+// fills in the hash of rn and anything under it that doesn't have one yet
+void
+rope_update_hash(struct rope_t *rn)
+{
+    if (rn == NULL || rn->has_hash) { return; }
+
+    if (rn->is_leaf) {
+        rn->hash = rope_hash_bytes(0, rope_leaf_bytes(rn), rn->total_byte_weight);
+        rn->has_hash = 1;
+        return;
+    }
+
+    uint64_t hash = 0;
+    for (int8_t k = 0; k < rn->child_count; k++) {
+        struct rope_t *child = rn->children[k];
+        rope_update_hash(child);
+
+        hash = rope_hash_join(hash, child->hash, child->total_byte_weight);
+    }
+
+    rn->hash = hash;
+    rn->has_hash = 1;
+}
+
+uint64_t
+rope_hash(struct rope_t *rn)
+{
+    if (rn == NULL) { return 0; }
+
+    rope_update_hash(rn);
+    return rn->hash;
+}
+
+// hash is the hash of whatever comes before bytes [start, end) of rn
+uint64_t
+rope_hash_bytes_between(struct rope_t *rn, uint64_t hash, int64_t start, int64_t end)
+{
+    if (start < 0) { start = 0; }
+    if (end > rn->total_byte_weight) { end = rn->total_byte_weight; }
+
+    if (start == 0 && end == rn->total_byte_weight) {
+        rope_update_hash(rn);
+        return rope_hash_join(hash, rn->hash, rn->total_byte_weight);
+    }
+
+    if (rn->is_leaf) {
+        return rope_hash_bytes(hash, rope_leaf_bytes(rn) + start, end - start);
+    }
+
+    int64_t child_start = 0;
+    for (int8_t k = 0; k < rn->child_count && child_start < end; k++) {
+        int64_t child_end = rn->byte_prefix[k];
+        if (child_end > start) {
+            hash = rope_hash_bytes_between(rn->children[k], hash, start - child_start, end - child_start);
+        }
+        child_start = child_end;
+    }
+
+    return hash;
+}
+
+uint64_t
+rope_hash_between(struct rope_t *rn, int64_t start, int64_t end)
+{
+    if (rn == NULL) { return 0; }
+
+    int64_t start_byte = byte_for_char_at(rn, start < 0 ? 0 : start);
+    int64_t end_byte = byte_for_char_at(rn, end);
+    if (end_byte <= start_byte) { return 0; }
+
+    return rope_hash_bytes_between(rn, 0, start_byte, end_byte);
+}
+
+int8_t
+rope_equal(struct rope_t *a, struct rope_t *b)
+{
+    if (a == b) { return 1; }
+
+    return rope_total_byte_length(a) == rope_total_byte_length(b) && rope_hash(a) == rope_hash(b);
+}
+
+// summaries
+int32_t
+rope_summary_register(struct rope_summary_type_t type)
+{
+    SE_ASSERT(rope_summary_type_count < ROPE_MAX_SUMMARY_TYPES);
+    SE_ASSERT(type.value_count > 0 && type.leaf_fn != NULL && type.combine_fn != NULL);
+    SE_ASSERT(type.seek_value < type.value_count && (type.seek_value < 0 || type.leaf_seek_fn != NULL));
+
+    if (rope_summary_types == NULL) {
+        rope_summary_types = se_alloc(ROPE_MAX_SUMMARY_TYPES, sizeof(struct rope_summary_type_t));
+    }
+
+    type.value_offset = rope_summary_value_count;
+    rope_summary_types[rope_summary_type_count] = type;
+    rope_summary_value_count += type.value_count;
+
+    return rope_summary_type_count++;
+}
+
+int64_t
+rope_node_size(int8_t is_leaf)
+{
+    return (int64_t) ROPE_NODE_SIZE(is_leaf) + rope_summary_value_count * (int64_t) sizeof(int64_t);
+}
+
+// the summary values are stored right after the node itself
+int64_t *
+rope_summary_values(struct rope_t *rn)
+{
+    return (int64_t *) ((char *) rn + ROPE_NODE_SIZE(rn->is_leaf));
+}
 
-    return rn->total_char_weight;
+const int64_t *
+rope_summary(struct rope_t *rn, int32_t summary)
+{
+    return rope_summary_values(rn) + rope_summary_types[summary].value_offset;
 }
 
-int64_t
-rope_total_line_break_length(struct rope_t *rn)
+void
+rope_leaf_summarize(struct rope_t *leaf)
 {
-    if (rn == NULL) {
-        return 0;
-    }
+    int64_t *values = rope_summary_values(leaf);
+    const char *bytes = rope_leaf_bytes(leaf);
 
-    return rn->total_line_break_weight;
+    for (int32_t t = 0; t < rope_summary_type_count; t++) {
+        struct rope_summary_type_t *type = rope_summary_types + t;
+        type->leaf_fn(bytes, leaf->total_byte_weight, values + type->value_offset);
+    }
 }
 
-int64_t
-rope_total_line_break_weight(struct rope_t *rn)
+void
+rope_parent_summarize(struct rope_t *rn)
 {
-    if (rn == NULL) { return 0; }
+    if (rope_summary_type_count == 0) { return; }
 
-    if (rn->left != NULL && rn->right != NULL) {
-        rn->total_line_break_weight = rn->left->total_line_break_weight + rn->right->total_line_break_weight;
-    }
-    else if (rn->left != NULL) {
-        rn->total_line_break_weight = rn->left->total_line_break_weight;
-    } else if (rn->right != NULL) {
-        rn->total_line_break_weight = rn->right->total_line_break_weight;
-    } else {
-        rn->total_line_break_weight = 0;
+    int64_t *values = rope_summary_values(rn);
+    int64_t combined[rope_summary_value_count];
+
+    for (int32_t t = 0; t < rope_summary_type_count; t++) {
+        struct rope_summary_type_t *type = rope_summary_types + t;
+        int64_t *out = values + type->value_offset;
+
+        memcpy(out, rope_summary_values(rn->children[0]) + type->value_offset, (size_t) type->value_count * sizeof(int64_t));
+        for (int8_t k = 1; k < rn->child_count; k++) {
+            type->combine_fn(out, rope_summary_values(rn->children[k]) + type->value_offset, combined);
+            memcpy(out, combined, (size_t) type->value_count * sizeof(int64_t));
+        }
     }
+}
 
-    return rn->total_line_break_weight;
+// rn's summaries are those of left followed by right, without going back to the bytes
+void
+rope_summary_combine_nodes(struct rope_t *rn, struct rope_t *left, struct rope_t *right)
+{
+    for (int32_t t = 0; t < rope_summary_type_count; t++) {
+        struct rope_summary_type_t *type = rope_summary_types + t;
+        type->combine_fn(rope_summary_values(left) + type->value_offset,
+                         rope_summary_values(right) + type->value_offset,
+                         rope_summary_values(rn) + type->value_offset);
+    }
 }
 
-int64_t
-rope_get_line_number_for_char_pos(struct rope_t *rn, int64_t char_pos)
+// out gets the summary of the first byte_offset bytes of rn
+void
+rope_summary_before_byte(struct rope_t *rn, int32_t summary, int64_t byte_offset, int64_t *out)
 {
-    if (rn == NULL) {
-        return 0;
+    struct rope_summary_type_t *type = rope_summary_types + summary;
+    int64_t part[type->value_count];
+    int64_t combined[type->value_count];
+
+    type->leaf_fn("", 0, out);
+    if (rn == NULL) { return; }
+
+    if (byte_offset >= rn->total_byte_weight) {
+        memcpy(out, rope_summary(rn, summary), (size_t) type->value_count * sizeof(int64_t));
+        return;
     }
 
-    if (rn->is_leaf) {
-        if (rn->char_weight < char_pos) {
-            return 0;
+    while (!rn->is_leaf) {
+        int8_t k = rope_child_for_byte(rn, byte_offset);
+        for (int8_t j = 0; j < k; j++) {
+            type->combine_fn(out, rope_summary(rn->children[j], summary), combined);
+            memcpy(out, combined, (size_t) type->value_count * sizeof(int64_t));
         }
 
-        int32_t byte_offset = 0;
-        int32_t line_count = 0;
-        for (int32_t i = 0; i < char_pos; i++) {
-            if (*(rn->str_buf->bytes + byte_offset) == '\n') { line_count += 1; }
-            byte_offset += bytes_in_codepoint_utf8(*(rn->str_buf->bytes + byte_offset));
-        }
-        return line_count;
+        if (k > 0) { byte_offset -= rn->byte_prefix[k - 1]; }
+        rn = rn->children[k];
     }
 
-    if (rn->char_weight - 1 < char_pos) {
-        return rope_total_line_break_length(rn->left)
-               + rope_get_line_number_for_char_pos(rn->right, char_pos - rn->char_weight);
-    } else {
-        if (rn->left != NULL) {
-            return rope_get_line_number_for_char_pos(rn->left, char_pos);
-        }
-        return 0;
+    if (byte_offset > 0) {
+        type->leaf_fn(rope_leaf_bytes(rn), byte_offset, part);
+        type->combine_fn(out, part, combined);
+        memcpy(out, combined, (size_t) type->value_count * sizeof(int64_t));
     }
 }
 
-struct rope_t *
-rope_insert(struct rope_t *rn, int64_t i, const char *text)
+// the first byte offset at which the summary's seek value, counted from the start of rn, reaches target
+int64_t
+rope_summary_seek(struct rope_t *rn, int32_t summary, int64_t target)
 {
-    struct rope_t *split_left;
-    struct rope_t *split_right;
-    rope_split_at_char(rn, i, &split_left, &split_right);
+    struct rope_summary_type_t *type = rope_summary_types + summary;
+    SE_ASSERT(type->seek_value >= 0);
 
-    struct rope_t *insert = rope_leaf_init(text);
+    if (rn == NULL || target <= 0) { return 0; }
+    if (target > rope_summary(rn, summary)[type->seek_value]) { return rn->total_byte_weight; }
 
-    struct rope_t *combined_left = rope_concat(split_left, insert);
-    struct rope_t *cat = rope_concat(combined_left, split_right);
+    int64_t byte_offset = 0;
+    while (!rn->is_leaf) {
+        int8_t k = 0;
+        while (k < rn->child_count - 1) {
+            int64_t child_value = rope_summary(rn->children[k], summary)[type->seek_value];
+            if (child_value >= target) { break; }
 
-    return cat;
-}
+            target -= child_value;
+            k += 1;
+        }
 
-struct rope_t *
-rope_delete(struct rope_t *rn, int64_t start, int64_t end)
-{
-    if (rope_total_char_length(rn) == 1) {
-        return rope_leaf_init("");
+        if (k > 0) { byte_offset += rn->byte_prefix[k - 1]; }
+        rn = rn->children[k];
     }
 
-    struct rope_t *split_end_left;
-    struct rope_t *split_end_right;
+    return byte_offset + type->leaf_seek_fn(rope_leaf_bytes(rn), rn->total_byte_weight, target);
+}
 
-    rope_split_at_char(rn, end, &split_end_left, &split_end_right);
+// utf-16 code units, e.g. for talking to anything that counts positions the way javascript does
+void
+rope_summary_utf16_leaf(const char *bytes, int64_t byte_length, int64_t *out)
+{
+    int64_t units = 0;
+    for (int64_t i = 0; i < byte_length; i++) {
+        char c = bytes[i];
+        if ((c & 0xC0) != 0x80) {
+            // anything outside the basic multilingual plane takes a surrogate pair
+            units += (c & 0xF8) == 0xF0 ? 2 : 1;
+        }
+    }
 
-    struct rope_t *split_start_left;
-    struct rope_t *split_start_right;
+    out[0] = units;
+}
 
-    rope_split_at_char(split_end_left, start, &split_start_left, &split_start_right);
+void
+rope_summary_utf16_combine(const int64_t *left, const int64_t *right, int64_t *out)
+{
+    out[0] = left[0] + right[0];
+}
 
-    struct rope_t *result = rope_concat(split_start_left, split_end_right);
+int64_t
+rope_summary_utf16_seek(const char *bytes, int64_t byte_length, int64_t target)
+{
+    int64_t units = 0;
+    int64_t i = 0;
+    while (i < byte_length && units < target) {
+        units += (bytes[i] & 0xF8) == 0xF0 ? 2 : 1;
+        i += bytes_in_codepoint_utf8(bytes[i]);
+    }
 
-    rope_free(split_end_left);
-    rope_free(split_start_right);
+    return i;
+}
 
-    return result;
+struct rope_summary_type_t
+rope_summary_type_utf16()
+{
+    struct rope_summary_type_t type;
+    type.value_count = 1;
+    type.leaf_fn = rope_summary_utf16_leaf;
+    type.combine_fn = rope_summary_utf16_combine;
+    type.seek_value = 0;
+    type.leaf_seek_fn = rope_summary_utf16_seek;
+    type.value_offset = 0;
+    return type;
 }
 
 // free
@@ -459,28 +2955,42 @@ rope_free(struct rope_t *rn)
     rn->rc = -1;
 
     if (!rn->is_leaf) {
-        rope_dec_rc(rn->left);
-        rope_dec_rc(rn->right);
+        for (int8_t k = 0; k < rn->child_count; k++) {
+            rope_dec_rc(rn->children[k]);
+        }
     }
     else {
-        buf_free(rn->str_buf);
+        rope_release_node(rn);
+    }
+
+    node_pool_free(rn);
+}
+
+// drops what a leaf holds outside of its pool. also used to let go of every leaf at once when a pool is released
+void
+rope_release_node(void *node)
+{
+    struct rope_t *rn = node;
+    if (!rn->is_leaf) { return; }
+
+    if (rn->in_leaf_store && rope_leaf_store != NULL) {
+        leaf_store_remove(rope_leaf_store, rn);
     }
 
-    se_free(rn);
+    buf_free(rn->str_buf);
+    se_free(rn->char_checkpoints);
+    se_free(rn->line_breaks);
 }
 
+
 void
 screen_free(struct editor_screen_t *screen)
 {
     if (screen == NULL) { return; }
 
-    int8_t freeing = screen->text != NULL
-                     && screen->lines != NULL
-                     && screen->text->rc == 1
-                     && screen->lines->rc == 1;
+    int8_t freeing = screen->text != NULL && screen->text->rc == 1;
 
     rope_dec_rc(screen->text);
-    line_rope_dec_rc(screen->lines);
 
     if (freeing && screen->cursor_infos != NULL) {
         vector_free(screen->cursor_infos);
@@ -514,7 +3024,6 @@ undo_stack_append(struct editor_buffer_t editor_buffer, struct editor_screen_t s
     screen_free(screen_to_overwrite);
 
     rope_inc_rc(screen.text);
-    line_rope_inc_rc(screen.lines);
 
     if (*editor_buffer.save_to_undo) {
         circular_buffer_append(editor_buffer.undo_buffer, &screen);
@@ -535,7 +3044,6 @@ global_only_undo_stack_append(struct editor_buffer_t editor_buffer, struct edito
     screen_free(screen_to_overwrite);
 
     rope_inc_rc(screen.text);
-    line_rope_inc_rc(screen.lines);
 
     if (*editor_buffer.save_to_undo) {
         circular_buffer_append(editor_buffer.global_undo_buffer, &screen);
@@ -545,14 +3053,16 @@ global_only_undo_stack_append(struct editor_buffer_t editor_buffer, struct edito
     *editor_buffer.global_undo_idx = editor_buffer.global_undo_buffer->length - 1;
 
     *editor_buffer.current_screen = screen;
+    rope_finger_reset(editor_buffer.finger);
 }
 
 void
 editor_buffer_copy_last_undo(struct editor_buffer_t editor_buffer)
 {
+    editor_buffer_use_node_pools(editor_buffer);
+
     struct editor_screen_t edited_screen;
     edited_screen.cursor_infos = vector_copy(editor_buffer.current_screen->cursor_infos);
-    edited_screen.lines = line_rope_shallow_copy(editor_buffer.current_screen->lines);
     edited_screen.text = rope_shallow_copy(editor_buffer.current_screen->text);
 
 //    int8_t save_to_undo = *editor_buffer.save_to_undo;
@@ -572,173 +3082,256 @@ editor_buffer_set_saves_to_undo(struct editor_buffer_t editor_buffer, int8_t sav
 int64_t
 editor_buffer_get_longest_line_length(struct editor_buffer_t editor_buffer)
 {
-    if (editor_buffer.current_screen->lines == NULL) {
-        return -1;
-    }
-
-    return editor_buffer.current_screen->lines->longest_child_line_length;
+    return rope_longest_line_length(editor_buffer.current_screen->text);
 }
 
 // helpers
 struct rope_t *
 rope_leaf_init_concat(struct rope_t *left, struct rope_t *right)
 {
-    struct rope_t *rn = rope_new(1,
-                                 left->byte_weight + right->byte_weight,
-                                 left->char_weight + right->char_weight);
+    int64_t byte_length = left->total_byte_weight + right->total_byte_weight;
+    int64_t char_length = left->total_char_weight + right->total_char_weight;
+    int64_t line_break_count = left->total_line_break_weight + right->total_line_break_weight;
+
+    struct rope_t *rn;
+    if (rope_leaves_adjacent(left, right)) {
+        // two halves of an earlier split going back together, the bytes are already where they need to be
+        rn = rope_leaf_init_slice(left->str_buf, left->str_offset, byte_length, char_length, line_break_count, left);
+    } else if (rope_leaf_can_append(left, right->total_byte_weight)) {
+        // right's bytes go in the spare room after left's, which no leaf covers, so every other leaf on the
+        // buffer (including left, in whichever snapshots still have it) reads exactly what it did before
+        buf_write_bytes(left->str_buf, rope_leaf_bytes(right), right->total_byte_weight);
+        rn = rope_leaf_init_slice(left->str_buf, left->str_offset, byte_length, char_length, line_break_count, left);
+    } else {
+        // a small right side is most likely typing, so leave room for the next keystrokes to be appended
+        int64_t capacity = byte_length;
+        if (right->total_byte_weight < MERGE_THRESHOLD) { capacity += APPEND_RESERVE; }
 
-    buf_id += 1;
-    rn->str_buf = buf_init_fmt("%str%str", left->str_buf->bytes, right->str_buf->bytes);
+        buf_id += 1;
+        struct buf_t *str_buf = buf_init_inline(capacity);
+        buf_write_bytes(str_buf, rope_leaf_bytes(left), left->total_byte_weight);
+        buf_write_bytes(str_buf, rope_leaf_bytes(right), right->total_byte_weight);
 
-    rn->line_break_weight = count_newlines(rn->str_buf->bytes);
-    rn->total_line_break_weight = rn->line_break_weight;
+        rn = rope_leaf_init_slice(str_buf, 0, byte_length, char_length, line_break_count, left);
+        buf_free(str_buf);
+    }
+
+    rn->has_replacement_chars = left->has_replacement_chars || right->has_replacement_chars;
+
+    rope_summary_combine_nodes(rn, left, right);
+
+    if (left->has_hash && right->has_hash) {
+        rn->hash = rope_hash_join(left->hash, right->hash, right->total_byte_weight);
+        rn->has_hash = 1;
+    }
+
+    // keep the line break tables going across the merge, typing into a line shouldn't mean rescanning its leaf
+    if (line_break_count > 0 && rope_leaf_has_line_breaks(left) && rope_leaf_has_line_breaks(right)) {
+        rn->line_breaks = se_alloc(line_break_count, sizeof(struct rope_line_break_t));
+        for (int64_t k = 0; k < left->total_line_break_weight; k++) {
+            rn->line_breaks[k] = left->line_breaks[k];
+        }
+        for (int64_t k = 0; k < right->total_line_break_weight; k++) {
+            rn->line_breaks[left->total_line_break_weight + k].byte_offset =
+                    (int32_t) (right->line_breaks[k].byte_offset + left->total_byte_weight);
+            rn->line_breaks[left->total_line_break_weight + k].char_offset =
+                    (int32_t) (right->line_breaks[k].char_offset + left->total_char_weight);
+        }
+    }
 
     rope_free(left);
     rope_free(right);
     return rn;
 }
 
+// writes bytes to out with each invalid utf-8 sequence swapped for U+FFFD, and returns how many bytes that
+// comes to. with out NULL it only counts them. first_invalid is where the first invalid sequence starts
+int64_t
+rope_write_replacing_invalid_utf8(const char *bytes, int64_t byte_length, int64_t first_invalid,
+                                  struct buf_t *out)
+{
+    int64_t written = 0;
+    int64_t i = 0;
+    int64_t invalid = first_invalid;
+
+    while (i < byte_length) {
+        // the valid run up to the next invalid sequence, then the replacement for it
+        if (out != NULL) { buf_write_bytes(out, bytes + i, invalid - i); }
+        written += invalid - i;
+        if (invalid == byte_length) { break; }
+
+        int32_t length;
+        utf8_check_sequence(bytes + invalid, byte_length - invalid, &length);
+
+        if (out != NULL) { buf_write_bytes(out, UTF8_REPLACEMENT_CHAR, 3); }
+        written += 3;
+
+        i = invalid + length;
+        invalid = i + scan_find_invalid_utf8(bytes + i, byte_length - i);
+    }
+
+    return written;
+}
+
+int8_t
+rope_contains_replacement_char(const char *bytes, int64_t byte_length)
+{
+    const char *end = bytes + byte_length;
+    const char *c = memchr(bytes, '\xEF', (size_t) byte_length);
+    while (c != NULL) {
+        if (end - c >= 3 && memcmp(c, UTF8_REPLACEMENT_CHAR, 3) == 0) { return 1; }
+        c = memchr(c + 1, '\xEF', (size_t) (end - c - 1));
+    }
+
+    return 0;
+}
+
+int8_t
+rope_leaves_adjacent(struct rope_t *left, struct rope_t *right)
+{
+    return left->str_buf == right->str_buf && left->str_offset + left->total_byte_weight == right->str_offset;
+}
+
+// whether byte_count more bytes fit right after the leaf's in its buffer. only the leaf that ends where the
+// buffer's text does can grow it, so once it has, any other leaf ending there has to copy instead
+int8_t
+rope_leaf_can_append(struct rope_t *leaf, int64_t byte_count)
+{
+    struct buf_t *str_buf = leaf->str_buf;
+
+    // the buffer keeps one byte for a terminating nul
+    return leaf->str_offset + leaf->total_byte_weight == str_buf->length
+           && str_buf->length + byte_count < str_buf->capacity;
+}
+
 struct rope_t *
 rope_shallow_copy(struct rope_t *rn)
 {
     if (rn == NULL) { return NULL; }
 
-    struct rope_t *copy = se_alloc(1, sizeof(struct rope_t));
-    memcpy(copy, rn, sizeof(struct rope_t));
+    struct rope_t *copy = rope_node_alloc(rn->is_leaf);
+    memcpy(copy, rn, (size_t) rope_node_size(rn->is_leaf));
 
     copy->rc = 0;
 
     if (!rn->is_leaf) {
-        rope_inc_rc(rn->left);
-        rope_inc_rc(rn->right);
+        for (int8_t k = 0; k < rn->child_count; k++) {
+            rope_inc_rc(rn->children[k]);
+        }
     } else {
         copy->str_buf = rn->str_buf;
         copy->str_buf->rc += 1;
+
+        copy->in_leaf_store = 0;
+
+        if (rn->char_checkpoints != NULL) {
+            int64_t checkpoint_count = (rn->total_char_weight - 1) / CHECKPOINT_INTERVAL;
+            copy->char_checkpoints = se_alloc(checkpoint_count, sizeof(int32_t));
+            memcpy(copy->char_checkpoints, rn->char_checkpoints, (size_t) checkpoint_count * sizeof(int32_t));
+        }
+
+        copy->line_breaks = NULL;
+        if (rn->line_breaks != NULL) {
+            rope_leaf_copy_line_breaks(copy, rn->line_breaks, 0, 0);
+        }
     }
 
     return copy;
 }
 
-struct rope_t *
-rope_new(int8_t is_leaf, int64_t byte_weight, int64_t char_weight)
+// the pool new nodes come from: the current buffer's, or the shared one when no buffer has set its pools
+struct node_pool_t *
+rope_current_pool(int8_t is_leaf)
 {
-    rope_id += 1;
-
-    struct rope_t *rn = se_alloc(1, sizeof(struct rope_t));
-
-    rn->rc = 0;
-    rn->is_leaf = is_leaf;
-    rn->byte_weight = byte_weight;
-    rn->char_weight = char_weight;
-    rn->total_char_weight = char_weight;
-    rn->total_byte_weight = byte_weight;
+    struct node_pool_t *pool = is_leaf ? rope_leaf_pool : rope_pool;
+    if (pool == NULL) {
+        struct node_pool_t **shared = is_leaf ? &shared_rope_leaf_pool : &shared_rope_pool;
+        if (*shared == NULL) {
+            *shared = node_pool_init(rope_node_size(is_leaf));
+        }
+        pool = *shared;
+    }
 
-    return rn;
+    return pool;
 }
 
-int64_t
-rope_total_byte_length(struct rope_t *rn)
+int8_t
+rope_node_in_current_pool(struct rope_t *rn)
 {
-    if (rn == NULL) { return 0; }
-
-    return rn->total_byte_weight;
+    return node_pool_for_node(rn) == rope_current_pool(rn->is_leaf);
 }
 
-int64_t
-rope_total_byte_weight(struct rope_t *rn)
+struct rope_t *
+rope_copy_into_current_pools(struct rope_t *rn)
 {
-    if (rn == NULL) { return 0; }
+    if (rn == NULL) { return NULL; }
 
-    if (rn->left != NULL && rn->right != NULL) {
-        rn->total_byte_weight = rn->left->total_byte_weight + rn->right->total_byte_weight;
-    }
-    else if (rn->left != NULL) {
-        rn->total_byte_weight = rn->left->total_byte_weight;
-    } else if (rn->right != NULL) {
-        rn->total_byte_weight = rn->right->total_byte_weight;
-    } else {
-        rn->total_byte_weight = 0;
+    struct rope_t *copy = rope_shallow_copy(rn);
+    if (copy->is_leaf) { return copy; }
+
+    // whatever's already in the pools is shared as it is, only the rest is copied
+    for (int8_t k = 0; k < copy->child_count; k++) {
+        struct rope_t *child = copy->children[k];
+        if (rope_node_in_current_pool(child)) { continue; }
+
+        copy->children[k] = rope_copy_into_current_pools(child);
+        rope_inc_rc(copy->children[k]);
+        rope_dec_rc(child);
     }
 
-    return rn->total_byte_weight;
+    return copy;
 }
 
-int64_t
-rope_byte_weight(struct rope_t *rn)
+struct rope_t *
+rope_node_alloc(int8_t is_leaf)
 {
-    if (rn == NULL) {
-        return 0;
-    }
+    struct node_pool_t *pool = rope_current_pool(is_leaf);
 
-    if (rn->is_leaf) {
-        return rn->byte_weight;
-    }
+    // a pool made before the last summary was registered has no room for it
+    SE_ASSERT(pool->node_size >= rope_node_size(is_leaf));
 
-    return rope_total_byte_length(rn->left);
+    return node_pool_alloc(pool);
 }
 
-int64_t
-rope_char_weight(struct rope_t *rn)
+struct rope_t *
+rope_new(int8_t is_leaf, int64_t byte_weight, int64_t char_weight)
 {
-    if (rn == NULL) {
-        return 0;
-    }
+    rope_id += 1;
 
-    if (rn->is_leaf) {
-        return rn->char_weight;
-    }
+    struct rope_t *rn = rope_node_alloc(is_leaf);
+
+    rn->rc = 0;
+    rn->is_leaf = is_leaf;
+    rn->height = 0;
+    rn->child_count = 0;
+    rn->total_char_weight = char_weight;
+    rn->total_byte_weight = byte_weight;
 
-    return rope_total_char_length(rn->left);
+    return rn;
 }
 
 int64_t
-rope_line_break_weight(struct rope_t *rn)
+rope_total_byte_length(struct rope_t *rn)
 {
-    if (rn == NULL) {
-        return 0;
-    }
-
-    if (rn->is_leaf) {
-        return count_newlines(rn->str_buf->bytes);
-    }
+    if (rn == NULL) { return 0; }
 
-    return rope_total_line_break_length(rn->left);
+    return rn->total_byte_weight;
 }
 
 int64_t
-count_newlines(const char *str)
+rope_total_byte_weight(struct rope_t *rn)
 {
-    if (str == NULL) { return 0; }
-    int64_t newline_count = 0;
-    for (const char *c = str; *c != 0; c++) {
-        if (*c == '\n') { newline_count += 1; }
-    }
-    return newline_count;
+    if (rn == NULL) { return 0; }
+
+    rope_update_weights(rn);
+    return rn->total_byte_weight;
 }
 
 int64_t
-count_newlines_length(const char *str, int64_t i, struct line_helper_t *line_helper)
+count_newlines(const char *str)
 {
     if (str == NULL) { return 0; }
-    int64_t newline_count = 0;
-
-    int64_t length = 0;
-
-    for (const char *c = str; *c != 0 && length < i; c += bytes_in_codepoint_utf8(*c), length++) {
-        if (*c == '\n') {
-            if (line_helper != NULL) {
-                int64_t line_length = line_helper->leftover + 1;
-                vector_append(line_helper->lines, &line_length);
-                line_helper->leftover = 0;
-            }
-            newline_count += 1;
-        }
-
-        if (line_helper != NULL) {
-            line_helper->leftover++;
-        }
-    }
-    return newline_count;
+    return scan_count_byte(str, (int64_t) strlen(str), '\n');
 }
 
 void
@@ -762,79 +3355,82 @@ rope_dec_rc(struct rope_t *rn)
     }
 }
 
+// the returned halves are owned by the caller: each is either a fresh node or a shallow copy,
+// and both share everything they can with rn, which is left untouched
 void
 rope_split_at_char(struct rope_t *rn, int64_t i,
                    struct rope_t **out_new_left,
                    struct rope_t **out_new_right)
 {
+    if (i <= 0) {
+        *out_new_left = NULL;
+        *out_new_right = rope_shallow_copy(rn);
+        return;
+    }
+    if (i >= rn->total_char_weight) {
+        *out_new_left = rope_shallow_copy(rn);
+        *out_new_right = NULL;
+        return;
+    }
+
     if (rn->is_leaf) {
-        if (i <= 0) {
-            *out_new_left = NULL;
-            *out_new_right = rope_shallow_copy(rn);
-        } else if (i >= rn->char_weight) {
-            *out_new_left = rope_shallow_copy(rn);
-            *out_new_right = NULL;
+        // both halves are slices of rn's buffer. if rn already knows where its line breaks are, so do they,
+        // otherwise only the line breaks on the shorter side get counted
+        const char *bytes = rope_leaf_bytes(rn);
+        int64_t byte_offset = rope_leaf_byte_offset_for_char(rn, i);
+
+        int64_t left_line_breaks;
+        if (rope_leaf_has_line_breaks(rn)) {
+            left_line_breaks = rope_leaf_line_breaks_before_byte(rn, byte_offset);
+        } else if (byte_offset <= rn->total_byte_weight / 2) {
+            left_line_breaks = rope_count_line_breaks(bytes, byte_offset);
         } else {
-            int32_t byte_offset = 0;
-            for (int32_t j = 0; j < i; j++) {
-                byte_offset += bytes_in_codepoint_utf8(*(rn->str_buf->bytes + byte_offset));
-            }
-            *out_new_right = rope_leaf_init(rn->str_buf->bytes + byte_offset);
-
-            struct buf_t *new_left_buf = buf_init_fmt("%bytes",
-                                                      rn->str_buf->bytes,
-                                                      byte_offset);
-            *out_new_left = rope_leaf_init(new_left_buf->bytes);
-            buf_free(new_left_buf);
+            left_line_breaks = rn->total_line_break_weight
+                               - rope_count_line_breaks(bytes + byte_offset, rn->total_byte_weight - byte_offset);
         }
-    } else {
-        struct rope_t *rn_copy = rope_shallow_copy(rn);
-        int used_rn_copy = 0;
-
-        if (i < rn_copy->char_weight) {
-            rope_set_right(rn_copy, NULL);
-
-            struct rope_t *new_gt_left;
-            struct rope_t *new_gt_right;
-            rope_split_at_char(rn_copy->left, i, &new_gt_left, &new_gt_right);
 
-            *out_new_right = rope_concat(new_gt_right, rn->right);
-
-            rope_set_left(rn_copy, new_gt_left);
-
-            *out_new_left = rn_copy;
-            used_rn_copy = 1;
-
-            (*out_new_left)->byte_weight = rope_byte_weight(*out_new_left);
-            (*out_new_left)->total_byte_weight = rope_total_byte_weight(*out_new_left);
-
-            (*out_new_left)->char_weight = rope_char_weight(*out_new_left);
-            (*out_new_left)->total_char_weight = rope_total_char_weight(*out_new_left);
+        *out_new_left = rope_leaf_init_slice(rn->str_buf, rn->str_offset,
+                                             byte_offset, i, left_line_breaks, rn);
+        *out_new_right = rope_leaf_init_slice(rn->str_buf, rn->str_offset + byte_offset,
+                                              rn->total_byte_weight - byte_offset,
+                                              rn->total_char_weight - i,
+                                              rn->total_line_break_weight - left_line_breaks,
+                                              NULL);
+        rope_leaf_summarize(*out_new_left);
+        rope_leaf_summarize(*out_new_right);
+
+        (*out_new_left)->has_replacement_chars = rn->has_replacement_chars;
+        (*out_new_right)->has_replacement_chars = rn->has_replacement_chars;
+
+        if (rn->line_breaks != NULL) {
+            rope_leaf_copy_line_breaks(*out_new_left, rn->line_breaks, 0, 0);
+            rope_leaf_copy_line_breaks(*out_new_right, rn->line_breaks + left_line_breaks, -byte_offset, -i);
+        }
+        return;
+    }
 
-            (*out_new_left)->line_break_weight = rope_line_break_weight(*out_new_left);
-            (*out_new_left)->total_line_break_weight = rope_total_line_break_weight(*out_new_left);
-        } else if (i > rn_copy->char_weight) {
-            struct rope_t *new_gt_left;
-            struct rope_t *new_gt_right;
-            rope_split_at_char(rn->right, i - rn_copy->char_weight, &new_gt_left, &new_gt_right);
+    int8_t k = rope_child_for_char(rn, i);
+    int64_t offset = k > 0 ? i - rn->char_prefix[k - 1] : i;
 
-            rope_set_right(rn_copy, new_gt_left);
+    struct rope_t *child_left = NULL;
+    struct rope_t *child_right = NULL;
+    int8_t right_start = k;
 
-            *out_new_left = rn_copy;
-            used_rn_copy = 1;
+    if (offset > 0) {
+        rope_split_at_char(rn->children[k], offset, &child_left, &child_right);
+        right_start = (int8_t) (k + 1);
+    }
 
-            *out_new_right = new_gt_right;
-        } else {
-            *out_new_left = rope_shallow_copy(rn_copy->left);
-            *out_new_right = rope_shallow_copy(rn_copy->right);
-        }
+    // the untouched siblings on either side of the split point are shared, not copied
+    struct rope_t *left_siblings = rope_parent_init_range(rn, 0, k);
+    struct rope_t *right_siblings = rope_parent_init_range(rn, right_start, (int8_t) (rn->child_count - right_start));
 
-        if (!used_rn_copy) {
-            rope_free(rn_copy);
-        }
-    }
+    *out_new_left = rope_concat(left_siblings, child_left);
+    *out_new_right = rope_concat(child_right, right_siblings);
 }
 
+// consumes both arguments: each one ends up either referenced by the result or freed.
+// the result keeps every leaf at the same depth, it is at most one level taller than the taller argument
 struct rope_t *
 rope_concat(struct rope_t *left, struct rope_t *right)
 {
@@ -844,22 +3440,90 @@ rope_concat(struct rope_t *left, struct rope_t *right)
     if (left == NULL) {
         return right;
     }
-    if (right->is_leaf) {
-        if (left->is_leaf) {
-            if (left->byte_weight + right->byte_weight < COPY_THRESHOLD) {
-                struct rope_t *cat = rope_leaf_init_concat(left, right);
-                return cat;
-            }
+
+    if (right->total_byte_weight == 0) {
+        rope_free(right);
+        return left;
+    }
+    if (left->total_byte_weight == 0) {
+        rope_free(left);
+        return right;
+    }
+
+    if (left->height == right->height) {
+        return rope_concat_same_height(left, right);
+    }
+
+    if (left->height > right->height) {
+        // walk down the right edge of left until the heights match
+        int8_t k = (int8_t) (left->child_count - 1);
+        struct rope_t *child = left->children[k];
+        rope_inc_rc(child);
+
+        struct rope_t *cat = rope_concat(child, right);
+        struct rope_t *result = rope_parent_replace_child(left, k, cat);
+
+        rope_free(left);
+        rope_dec_rc(child);
+        return result;
+    }
+
+    // walk down the left edge of right until the heights match
+    struct rope_t *child = right->children[0];
+    rope_inc_rc(child);
+
+    struct rope_t *cat = rope_concat(left, child);
+    struct rope_t *result = rope_parent_replace_child(right, 0, cat);
+
+    rope_free(right);
+    rope_dec_rc(child);
+    return result;
+}
+
+struct rope_t *
+rope_concat_same_height(struct rope_t *left, struct rope_t *right)
+{
+    if (left->is_leaf) {
+        int64_t byte_length = left->total_byte_weight + right->total_byte_weight;
+
+        // neighbouring slices of the same buffer can always go back together, and text that fits in the room
+        // left has to grow into is only appended, there's nothing to copy in either case
+        if (byte_length < COPY_THRESHOLD
+            && (rope_leaves_adjacent(left, right) || rope_leaf_can_append(left, right->total_byte_weight))) {
+            return rope_leaf_init_concat(left, right);
         }
-        else if (left->right == NULL) {
-            rope_set_right(left, right);
-            return left;
+
+        int8_t mergeable = left->total_byte_weight < MERGE_THRESHOLD || right->total_byte_weight < MERGE_THRESHOLD;
+
+        // a leaf that's still being typed onto isn't copied out of its buffer together with what follows it
+        // unless they're both small, or the next keystroke would split them apart and copy it all over again
+        if (rope_leaf_can_append(left, 1)) { mergeable = byte_length < MERGE_THRESHOLD; }
+
+        if (mergeable && byte_length < COPY_THRESHOLD) {
+            return rope_leaf_init_concat(left, right);
+        }
+    } else {
+        // pool both child lists and share them back out, so two thin nodes become one and
+        // two crowded ones come out at least half full
+        struct rope_t *children[2 * ROPE_MAX_CHILDREN];
+        int64_t count = 0;
+
+        for (int8_t k = 0; k < left->child_count; k++) {
+            children[count++] = left->children[k];
         }
-        else if (left->right->is_leaf && left->right->byte_weight + right->byte_weight < COPY_THRESHOLD) {
-            rope_set_right(left, rope_leaf_init_concat(left->right, right));
-            return left;
+        for (int8_t k = 0; k < right->child_count; k++) {
+            children[count++] = right->children[k];
         }
+
+        struct rope_t *cat = rope_parent_init_many(children, count);
+
+        rope_free(left);
+        rope_free(right);
+        return cat;
     }
 
-    return rope_parent_init(left, right);
+    struct rope_t *pair[2];
+    pair[0] = left;
+    pair[1] = right;
+    return rope_parent_init_children(pair, 2);
 }
@@ -4,14 +4,14 @@
 #include "forward_types.h"
 
 // init
-struct rope_t *
-rope_parent_init(struct rope_t *left, struct rope_t *right);
-
 struct rope_t *
 rope_leaf_init(const char *text);
 
-struct rope_t *
-rope_leaf_init_lines(const char *text, struct line_helper_t *line_helper);
+// off to begin with. while it's on, text that goes into a rope shares any leaf already holding the same bytes
+// (of the leaves of at least 1KB that rope_leaf_init_length cuts), in this buffer or another one, so opening the
+// same file twice stores it once. the price is a hash and a lookup per leaf
+void
+rope_leaf_store_set_enabled(int8_t enabled);
 
 struct rope_t *
 rope_shallow_copy(struct rope_t *rn);
@@ -20,12 +20,6 @@ int64_t
 count_newlines(const char *str);
 
 // methods
-void
-rope_set_right(struct rope_t *target, struct rope_t *new_right);
-
-void
-rope_set_left(struct rope_t *target, struct rope_t *new_left);
-
 const char *
 rope_char_at(struct rope_t *rn, int64_t i);
 
@@ -35,12 +29,13 @@ rope_char_number_at_line(struct rope_t *rn, int64_t i);
 const char
 rope_byte_at(struct rope_t *rn, int64_t i);
 
+// a leaf's bytes, which are not nul terminated
+const char *
+rope_leaf_bytes(struct rope_t *leaf);
+
 int64_t
 byte_for_char_at(struct rope_t *rn, int64_t i);
 
-struct rope_t *
-rope_byte_at_incremental(struct rope_t *rn, struct rope_t *leaf, int64_t i, int64_t *out);
-
 int64_t
 rope_char_for_byte_at(struct rope_t *rn, int64_t i);
 
@@ -62,6 +57,10 @@ rope_total_line_break_length(struct rope_t *rn);
 int64_t
 rope_total_line_break_weight(struct rope_t *rn);
 
+// whether any of the text had invalid utf-8 in it, which was replaced with U+FFFD when it went into the rope
+int8_t
+rope_has_replacement_chars(struct rope_t *rn);
+
 int64_t
 rope_get_line_number_for_char_pos(struct rope_t *rn, int64_t char_pos);
 
@@ -71,16 +70,254 @@ rope_insert(struct rope_t *rn, int64_t i, const char *text);
 struct rope_t *
 rope_delete(struct rope_t *rn, int64_t start, int64_t end);
 
+// the chars [start, end) of rn, sharing everything but the nodes along the two cut edges with it.
+// rn is left untouched
+struct rope_t *
+rope_slice(struct rope_t *rn, int64_t start, int64_t end);
+
+// like rope_insert, with the text spliced in as it is rather than copied. insert is left untouched and
+// ends up shared with the result
+struct rope_t *
+rope_insert_rope(struct rope_t *rn, int64_t i, struct rope_t *insert);
+
+// a rope with the same text as rn whose nodes all come from the current pools (see
+// editor_buffer_use_node_pools), so it doesn't depend on the pools rn came from. nodes rn already has in
+// them are shared, and so are the leaves' text buffers
+struct rope_t *
+rope_copy_into_current_pools(struct rope_t *rn);
+
+// rebuilds rn with every parent as full as possible and runs of small leaves packed together.
+// leaves are shared with rn, which is left untouched. edits never need this to stay balanced: each one splits
+// and merges only the nodes along its path, keeping every leaf at the same depth and every parent but the root
+// at least ROPE_MIN_CHILDREN full, so it's only ever about packing
+struct rope_t *
+rope_balance(struct rope_t *rn);
+
+// a bounded piece of rope_balance, for doing a little at a time while the editor is idle. the run of (at most)
+// leaf_budget leaves from the one holding char *position on has its small leaves folded together, and is spliced
+// back into a copy of rn that has the same text. returns that copy, or NULL when the run had nothing to fold.
+// either way *position moves past the run, so it's at the end of the rope once a pass over all of it is done
+struct rope_t *
+rope_compact_step(struct rope_t *rn, int64_t *position, int64_t leaf_budget);
+
+int64_t
+rope_height(struct rope_t *rn);
+
 void
 rope_inc_rc(struct rope_t *rn);
 
 void
 rope_dec_rc(struct rope_t *rn);
 
+// lines
+// line lengths are in chars and don't count the '\n'. a line wrapped every wrap_width chars takes up
+// ceil(length / wrap_width) rows, and an empty one still takes up one. with ROPE_WRAP_WORDS in wrap_width, rows
+// break after the last space or tab that fits instead, and with ROPE_WRAP_DISPLAY the width is in display columns,
+// and a line takes up as many rows as that makes
+void
+rope_update_line_summary(struct rope_t *rn, int64_t wrap_width);
+
+// -1 if there's no such line
+int64_t
+rope_line_length(struct rope_t *rn, int64_t line);
+
+int64_t
+rope_longest_line_length(struct rope_t *rn);
+
+int64_t
+rope_wrap_row_count(struct rope_t *rn, int64_t wrap_width);
+
+// rows taken up by every line before the given one
+int64_t
+rope_wrap_rows_before_line(struct rope_t *rn, int64_t wrap_width, int64_t line);
+
+// the line the given row is part of. rows past the end are part of the last line
+int64_t
+rope_line_for_wrap_row(struct rope_t *rn, int64_t wrap_width, int64_t row);
+
+// where in the line its given row starts, in chars. rows past its last one are its last one
+int64_t
+rope_wrap_row_start(struct rope_t *rn, int64_t wrap_width, int64_t line, int64_t row);
+
+// the row of the line that the char col chars into it is on
+int64_t
+rope_wrap_row_for_col(struct rope_t *rn, int64_t wrap_width, int64_t line, int64_t col);
+
+// the column of its row that the char col chars into the line is at, in display columns with ROPE_WRAP_DISPLAY
+int64_t
+rope_wrap_display_col(struct rope_t *rn, int64_t wrap_width, int64_t line, int64_t col);
+
+// the other way around: the char in the line at display_col on its given row, clamped to the row
+int64_t
+rope_wrap_char_for_display_col(struct rope_t *rn, int64_t wrap_width, int64_t line, int64_t row,
+                               int64_t display_col);
+
+// everything rope_line_for_wrap_row, rope_char_number_at_line, rope_line_length and rope_wrap_rows_before_line
+// would say about the row, from a single descent
+void
+rope_wrap_locate_row(struct rope_t *rn, int64_t wrap_width, int64_t row, struct rope_wrap_point_t *out);
+
+// rope_wrap_locate_row for each of row_count rows, which have to be in order. rows close together, like the ones
+// on screen, are found by walking on from the one before rather than descending again
+void
+rope_wrap_locate_rows(struct rope_t *rn, int64_t wrap_width, const int64_t *rows, int64_t row_count,
+                      struct rope_wrap_point_t *out);
+
+// rope_wrap_char_for_display_col for a located row, as a position in the whole rope
+int64_t
+rope_wrap_point_char(struct rope_t *rn, int64_t wrap_width, const struct rope_wrap_point_t *point,
+                     int64_t display_col);
+
+// fills out with the row_count rows from start_row on, wrapped at wrap_width or one per line when it's 0, as
+// fragments of rn's leaves. it stops early at the end of the text or when out runs out of room, and returns how
+// many rows it got to. nothing is allocated or copied, so the fragments are good for as long as rn is
+int64_t
+rope_get_rows(struct rope_t *rn, int64_t wrap_width, int64_t start_row, int64_t row_count, struct rope_rows_t *out);
+
+// hashes
+// a hash of the text, the same for any two ropes holding the same text however they were built. it's worked out
+// on demand and kept on the nodes, so after an edit only the nodes the edit made get hashed again
+uint64_t
+rope_hash(struct rope_t *rn);
+
+// the hash of chars [start, end), the same as rope_hash of a rope holding only those chars
+uint64_t
+rope_hash_between(struct rope_t *rn, int64_t start, int64_t end);
+
+// whether a and b hold the same text, going by their lengths and hashes. two different texts of n bytes
+// only compare equal when their hashes collide, which happens with odds of about n in 2^61
+int8_t
+rope_equal(struct rope_t *a, struct rope_t *b);
+
+// summaries
+// returns the id the summary is looked up by. has to happen before the first rope (or editor_buffer) is made
+int32_t
+rope_summary_register(struct rope_summary_type_t type);
+
+// the summary of the whole of rn
+const int64_t *
+rope_summary(struct rope_t *rn, int32_t summary);
+
+// out gets the summary of the first byte_offset bytes of rn
+void
+rope_summary_before_byte(struct rope_t *rn, int32_t summary, int64_t byte_offset, int64_t *out);
+
+// the first byte offset at which the summary's seek value reaches target
+int64_t
+rope_summary_seek(struct rope_t *rn, int32_t summary, int64_t target);
+
+// a node's size including its summaries
+int64_t
+rope_node_size(int8_t is_leaf);
+
+// ready-made summaries
+struct rope_summary_type_t
+rope_summary_type_utf16();
+
+// iter
+// positions past either end are clamped to it
+void
+rope_iter_init_at_byte(struct rope_iter_t *iter, struct rope_t *rn, int64_t i);
+
+void
+rope_iter_init_at_char(struct rope_iter_t *iter, struct rope_t *rn, int64_t i);
+
+// the start of the given line
+void
+rope_iter_init_at_line(struct rope_iter_t *iter, struct rope_t *rn, int64_t line);
+
+// seeks climb only as far as they need to from where the iterator is, so nearby positions are cheap
+void
+rope_iter_seek_char(struct rope_iter_t *iter, int64_t i);
+
+void
+rope_iter_seek_line(struct rope_iter_t *iter, int64_t line);
+
+// the bytes from the iterator to the end of its leaf. at the end of the rope the length is 0
+void
+rope_iter_chunk(struct rope_iter_t *iter, const char **out_bytes, int64_t *out_length);
+
+// moves to the start of the next leaf, or returns 0 if this is the last one
+int8_t
+rope_iter_next_chunk(struct rope_iter_t *iter);
+
+// moves to the end of the previous leaf, or returns 0 if this is the first one
+int8_t
+rope_iter_prev_chunk(struct rope_iter_t *iter);
+
+int8_t
+rope_iter_at_end(struct rope_iter_t *iter);
+
+// -1 at the end of the rope
+char
+rope_iter_byte(struct rope_iter_t *iter);
+
+// NULL at the end of the rope
+const char *
+rope_iter_char(struct rope_iter_t *iter);
+
+int64_t
+rope_iter_byte_pos(struct rope_iter_t *iter);
+
+int64_t
+rope_iter_char_pos(struct rope_iter_t *iter);
+
+int64_t
+rope_iter_line_number(struct rope_iter_t *iter);
+
+// each of the moves returns 0 and leaves the iterator where it was when there's nowhere to go
+int8_t
+rope_iter_next_byte(struct rope_iter_t *iter);
+
+int8_t
+rope_iter_prev_byte(struct rope_iter_t *iter);
+
+int8_t
+rope_iter_next_char(struct rope_iter_t *iter);
+
+int8_t
+rope_iter_prev_char(struct rope_iter_t *iter);
+
+// to the start of the next line
+int8_t
+rope_iter_next_line(struct rope_iter_t *iter);
+
+// to the start of the previous line
+int8_t
+rope_iter_prev_line(struct rope_iter_t *iter);
+
+// finger
+// an iterator kept around between queries on the same rope. it doesn't hold a reference, so it has to be
+// reset before the rope it's on might be freed, and it starts over whenever it's asked about a different rope
+void
+rope_finger_reset(struct rope_finger_t *finger);
+
+struct rope_iter_t *
+rope_finger_at_char(struct rope_finger_t *finger, struct rope_t *rn, int64_t i);
+
+struct rope_iter_t *
+rope_finger_at_line(struct rope_finger_t *finger, struct rope_t *rn, int64_t line);
+
+// the same as rope_char_at, rope_get_line_number_for_char_pos, rope_char_number_at_line and rope_line_length
+const char *
+rope_finger_char_at(struct rope_finger_t *finger, struct rope_t *rn, int64_t i);
+
+int64_t
+rope_finger_line_for_char(struct rope_finger_t *finger, struct rope_t *rn, int64_t char_pos);
+
+int64_t
+rope_finger_char_number_at_line(struct rope_finger_t *finger, struct rope_t *rn, int64_t line);
+
+int64_t
+rope_finger_line_length(struct rope_finger_t *finger, struct rope_t *rn, int64_t line);
+
 // free
 void
 rope_free(struct rope_t *rn);
 
+void
+rope_release_node(void *node);
+
 // undo stack
 void
 global_only_undo_stack_append(struct editor_buffer_t editor_buffer, struct editor_screen_t screen);
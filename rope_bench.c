@@ -0,0 +1,302 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "forward_types.h"
+#include "rope.h"
+#include "util.h"
+#include "node_pool.h"
+
+#define BENCH_TEXT_BYTES (64 * 1024 * 1024)
+#define BENCH_LOOKUPS 100000
+#define BENCH_EDITS 20000
+#define BENCH_PASTES 1000
+#define BENCH_PASTE_CHARS (1024 * 1024)
+#define BENCH_COMPACT_LEAVES 64
+#define BENCH_WRAP_QUERIES 100
+#define BENCH_VIEWPORTS 10000
+#define BENCH_VIEWPORT_ROWS 60
+#define BENCH_SCREEN_LINES 100
+#define BENCH_SCREEN_FRAGMENTS 400
+
+uint64_t bench_rng_state = 0x9E3779B97F4A7C15ULL;
+
+int64_t
+bench_random(int64_t n)
+{
+    bench_rng_state ^= bench_rng_state << 13;
+    bench_rng_state ^= bench_rng_state >> 7;
+    bench_rng_state ^= bench_rng_state << 17;
+
+    if (n <= 0) { return 0; }
+    return (int64_t) (bench_rng_state % (uint64_t) n);
+}
+
+double
+bench_seconds_since(clock_t start)
+{
+    return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+char *
+bench_make_text(int64_t byte_count)
+{
+    // log-like lines with the occasional multi-byte character
+    const char *words[] = {"INFO", "WARN", "request", "served", "in", "ms", "user=\xc3\xa9lodie", "\xe2\x82\xac", "{\"id\":", "42}"};
+
+    char *text = se_alloc(byte_count + 64, sizeof(char));
+    int64_t length = 0;
+    int64_t line_length = 0;
+    while (length < byte_count) {
+        const char *word = words[bench_random(sizeof(words) / sizeof(words[0]))];
+        int64_t word_length = (int64_t) strlen(word);
+        memcpy(text + length, word, (size_t) word_length);
+        length += word_length;
+        line_length += word_length;
+
+        if (line_length > 60 + bench_random(60)) {
+            text[length++] = '\n';
+            line_length = 0;
+        } else {
+            text[length++] = ' ';
+        }
+    }
+    text[length] = '\0';
+
+    return text;
+}
+
+struct rope_t *
+bench_replace(struct rope_t *old_root, struct rope_t *new_root)
+{
+    rope_inc_rc(new_root);
+    rope_dec_rc(old_root);
+    return new_root;
+}
+
+int
+main()
+{
+    char *text = bench_make_text(BENCH_TEXT_BYTES);
+
+    clock_t start = clock();
+    struct rope_t *rn = rope_leaf_init(text);
+    rope_inc_rc(rn);
+    printf("build          %8.3fs  (%lld bytes, %lld chars, %lld lines)\n",
+           bench_seconds_since(start),
+           (long long) rope_total_byte_length(rn),
+           (long long) rope_total_char_length(rn),
+           (long long) rope_total_line_break_length(rn));
+
+    int64_t char_count = rope_total_char_length(rn);
+    int64_t line_count = rope_total_line_break_length(rn);
+    int64_t checksum = 0;
+
+    start = clock();
+    checksum += (int64_t) rope_hash(rn);
+    printf("hash           %8.3fs  (the whole text, the first time it's asked for)\n", bench_seconds_since(start));
+
+    start = clock();
+    for (int64_t i = 0; i < BENCH_LOOKUPS; i++) {
+        checksum += *rope_char_at(rn, bench_random(char_count));
+    }
+    printf("char_at        %8.3fs  (%d lookups)\n", bench_seconds_since(start), BENCH_LOOKUPS);
+
+    start = clock();
+    for (int64_t i = 0; i < BENCH_LOOKUPS; i++) {
+        checksum += byte_for_char_at(rn, bench_random(char_count));
+    }
+    printf("byte_for_char  %8.3fs  (%d lookups)\n", bench_seconds_since(start), BENCH_LOOKUPS);
+
+    start = clock();
+    for (int64_t i = 0; i < BENCH_LOOKUPS; i++) {
+        checksum += rope_get_line_number_for_char_pos(rn, bench_random(char_count));
+    }
+    printf("line_for_char  %8.3fs  (%d lookups)\n", bench_seconds_since(start), BENCH_LOOKUPS);
+
+    start = clock();
+    for (int64_t i = 0; i < BENCH_LOOKUPS; i++) {
+        checksum += rope_char_number_at_line(rn, bench_random(line_count));
+    }
+    printf("char_for_line  %8.3fs  (%d lookups)\n", bench_seconds_since(start), BENCH_LOOKUPS);
+
+    start = clock();
+    for (int64_t i = 0; i < BENCH_EDITS; i++) {
+        int64_t at = bench_random(rope_total_char_length(rn) + 1);
+        rn = bench_replace(rn, rope_insert(rn, at, "x"));
+    }
+    printf("insert         %8.3fs  (%d random single-char inserts)\n", bench_seconds_since(start), BENCH_EDITS);
+
+    start = clock();
+    for (int64_t i = 0; i < BENCH_EDITS; i++) {
+        int64_t at = bench_random(rope_total_char_length(rn) - 8);
+        rn = bench_replace(rn, rope_delete(rn, at, at + 1 + bench_random(8)));
+    }
+    printf("delete         %8.3fs  (%d random deletes of 1-8 chars)\n", bench_seconds_since(start), BENCH_EDITS);
+
+    start = clock();
+    int64_t typing_at = bench_random(rope_total_char_length(rn));
+    for (int64_t i = 0; i < BENCH_EDITS; i++) {
+        rn = bench_replace(rn, rope_insert(rn, typing_at + i, "x"));
+    }
+    printf("typing         %8.3fs  (%d single-char inserts, one after another)\n", bench_seconds_since(start), BENCH_EDITS);
+
+    // a slice pasted somewhere else, then deleted again so the text keeps its size
+    start = clock();
+    for (int64_t i = 0; i < BENCH_PASTES; i++) {
+        int64_t from = bench_random(rope_total_char_length(rn) - BENCH_PASTE_CHARS);
+        struct rope_t *slice = rope_slice(rn, from, from + BENCH_PASTE_CHARS);
+
+        int64_t at = bench_random(rope_total_char_length(rn));
+        rn = bench_replace(rn, rope_insert_rope(rn, at, slice));
+        rope_free(slice);
+
+        rn = bench_replace(rn, rope_delete(rn, at, at + BENCH_PASTE_CHARS));
+    }
+    printf("paste          %8.3fs  (%d pastes and deletes of %d chars)\n", bench_seconds_since(start), BENCH_PASTES,
+           BENCH_PASTE_CHARS);
+    printf("height         %9lld\n", (long long) rope_height(rn));
+
+    start = clock();
+    for (int64_t i = 0; i < BENCH_LOOKUPS; i++) {
+        checksum += *rope_char_at(rn, bench_random(rope_total_char_length(rn)));
+    }
+    printf("char_at edited %8.3fs  (%d lookups)\n", bench_seconds_since(start), BENCH_LOOKUPS);
+
+    // two views of the text at different widths, asked about in turn
+    start = clock();
+    for (int64_t i = 0; i < BENCH_WRAP_QUERIES; i++) {
+        int64_t wrap_width = i % 2 == 0 ? 80 : 120;
+        checksum += rope_wrap_rows_before_line(rn, wrap_width, bench_random(rope_total_line_break_length(rn) + 1));
+    }
+    printf("wrap 2 widths  %8.3fs  (%d row lookups, alternating between widths 80 and 120)\n",
+           bench_seconds_since(start), BENCH_WRAP_QUERIES);
+
+    start = clock();
+    for (int64_t i = 0; i < BENCH_WRAP_QUERIES; i++) {
+        int64_t line = bench_random(rope_total_line_break_length(rn) + 1);
+        checksum += rope_wrap_rows_before_line(rn, 80 | ROPE_WRAP_WORDS, line);
+    }
+    printf("word wrap      %8.3fs  (%d row lookups at width 80, wrapping at word boundaries)\n",
+           bench_seconds_since(start), BENCH_WRAP_QUERIES);
+
+    start = clock();
+    for (int64_t i = 0; i < BENCH_WRAP_QUERIES; i++) {
+        int64_t line = bench_random(rope_total_line_break_length(rn) + 1);
+        checksum += rope_wrap_rows_before_line(rn, 80 | ROPE_WRAP_WORDS | ROPE_WRAP_DISPLAY, line);
+    }
+    printf("display wrap   %8.3fs  (%d row lookups at width 80, in display columns at word boundaries)\n",
+           bench_seconds_since(start), BENCH_WRAP_QUERIES);
+
+    // a screenful of rows at a time, looked up one by one and then all together
+    int64_t viewport_rows[BENCH_VIEWPORT_ROWS];
+    struct rope_wrap_point_t viewport_points[BENCH_VIEWPORT_ROWS];
+    int64_t row_count = rope_wrap_row_count(rn, 80);
+
+    start = clock();
+    for (int64_t i = 0; i < BENCH_VIEWPORTS; i++) {
+        int64_t first_row = bench_random(row_count);
+        for (int64_t n = 0; n < BENCH_VIEWPORT_ROWS; n++) {
+            rope_wrap_locate_row(rn, 80, first_row + n, &viewport_points[n]);
+            checksum += viewport_points[n].line_start;
+        }
+    }
+    printf("viewport rows  %8.3fs  (%d screens of %d rows at width 80, one row at a time)\n",
+           bench_seconds_since(start), BENCH_VIEWPORTS, BENCH_VIEWPORT_ROWS);
+
+    start = clock();
+    for (int64_t i = 0; i < BENCH_VIEWPORTS; i++) {
+        int64_t first_row = bench_random(row_count);
+        for (int64_t n = 0; n < BENCH_VIEWPORT_ROWS; n++) { viewport_rows[n] = first_row + n; }
+
+        rope_wrap_locate_rows(rn, 80, viewport_rows, BENCH_VIEWPORT_ROWS, viewport_points);
+        for (int64_t n = 0; n < BENCH_VIEWPORT_ROWS; n++) { checksum += viewport_points[n].line_start; }
+    }
+    printf("viewport batch %8.3fs  (the same, all the rows of a screen together)\n", bench_seconds_since(start));
+
+    // drawing a screen: each line copied out on its own, then all of them as fragments of the leaves
+    start = clock();
+    for (int64_t i = 0; i < BENCH_VIEWPORTS; i++) {
+        int64_t first_line = bench_random(rope_total_line_break_length(rn) - BENCH_SCREEN_LINES);
+        for (int64_t line = first_line; line < first_line + BENCH_SCREEN_LINES; line++) {
+            int64_t line_start = rope_char_number_at_line(rn, line);
+            int64_t start_byte = byte_for_char_at(rn, line_start);
+            int64_t end_byte = byte_for_char_at(rn, line_start + rope_line_length(rn, line));
+
+            char *copy = se_alloc(end_byte - start_byte + 1, sizeof(char));
+            struct rope_iter_t iter;
+            rope_iter_init_at_byte(&iter, rn, start_byte);
+            for (int64_t copied = 0; copied < end_byte - start_byte;) {
+                const char *bytes;
+                int64_t length;
+                rope_iter_chunk(&iter, &bytes, &length);
+                if (length > end_byte - start_byte - copied) { length = end_byte - start_byte - copied; }
+
+                memcpy(copy + copied, bytes, (size_t) length);
+                copied += length;
+                if (!rope_iter_next_chunk(&iter)) { break; }
+            }
+            checksum += copy[0];
+            se_free(copy);
+        }
+    }
+    printf("screen copies  %8.3fs  (%d screens of %d lines, each line copied out)\n", bench_seconds_since(start),
+           BENCH_VIEWPORTS, BENCH_SCREEN_LINES);
+
+    struct rope_row_t screen_rows[BENCH_SCREEN_LINES];
+    struct rope_fragment_t screen_fragments[BENCH_SCREEN_FRAGMENTS];
+    struct rope_rows_t screen = {screen_rows, BENCH_SCREEN_LINES, 0, screen_fragments, BENCH_SCREEN_FRAGMENTS, 0};
+
+    start = clock();
+    for (int64_t i = 0; i < BENCH_VIEWPORTS; i++) {
+        int64_t first_line = bench_random(rope_total_line_break_length(rn) - BENCH_SCREEN_LINES);
+        rope_get_rows(rn, 0, first_line, BENCH_SCREEN_LINES, &screen);
+        for (int64_t n = 0; n < screen.fragment_count; n++) { checksum += screen_fragments[n].bytes[0]; }
+    }
+    printf("screen rows    %8.3fs  (the same with rope_get_rows, nothing copied)\n", bench_seconds_since(start));
+
+    int64_t leaves_before_compact = node_pool_live_count(shared_rope_leaf_pool);
+    int64_t compact_steps = 0;
+    start = clock();
+    for (int64_t position = 0; position < rope_total_char_length(rn); compact_steps++) {
+        struct rope_t *compacted = rope_compact_step(rn, &position, BENCH_COMPACT_LEAVES);
+        if (compacted != NULL) { rn = bench_replace(rn, compacted); }
+    }
+    printf("compact        %8.3fs  (%lld steps of %d leaves, %lld leaves -> %lld)\n", bench_seconds_since(start),
+           (long long) compact_steps, BENCH_COMPACT_LEAVES, (long long) leaves_before_compact,
+           (long long) node_pool_live_count(shared_rope_leaf_pool));
+
+    int64_t parent_count = node_pool_live_count(shared_rope_pool);
+    int64_t leaf_count = node_pool_live_count(shared_rope_leaf_pool);
+    int64_t node_bytes = parent_count * rope_node_size(0) + leaf_count * rope_node_size(1);
+    printf("nodes          %9lld parents, %lld leaves (%lld peak), %.1fKB per MB of text\n",
+           (long long) parent_count,
+           (long long) leaf_count,
+           (long long) node_pool_peak_count(shared_rope_leaf_pool),
+           (double) node_bytes / ((double) rope_total_byte_length(rn) / 1024.0));
+
+    // the same text twice more with the leaf store on: the first time fills it, the second only finds what's there
+    rope_leaf_store_set_enabled(1);
+    start = clock();
+    struct rope_t *stored = rope_leaf_init(text);
+    rope_inc_rc(stored);
+    printf("store build    %8.3fs  (the text again, with the leaf store on)\n", bench_seconds_since(start));
+
+    int64_t buf_bytes_before = buf_size;
+    start = clock();
+    struct rope_t *deduped = rope_leaf_init(text);
+    rope_inc_rc(deduped);
+    printf("store rebuild  %8.3fs  (and once more, %lld new bytes of text)\n", bench_seconds_since(start),
+           (long long) (buf_size - buf_bytes_before));
+    checksum += rope_equal(stored, deduped);
+
+    rope_dec_rc(deduped);
+    rope_dec_rc(stored);
+    rope_leaf_store_set_enabled(0);
+
+    printf("checksum %lld\n", (long long) checksum);
+
+    rope_dec_rc(rn);
+    se_free(text);
+    return 0;
+}
@@ -0,0 +1,477 @@
+#include <string.h>
+
+#include "scan.h"
+#include "util.h"
+
+// the vector kernels are compiled for their instruction sets function by function, so the rest of the program
+// doesn't have to be, and only run once scan_level has checked the cpu has them
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SCAN_X86 1
+#include <immintrin.h>
+#else
+#define SCAN_X86 0
+#endif
+
+#define SCAN_ONES 0x0101010101010101ULL
+#define SCAN_HIGH_BITS 0x8080808080808080ULL
+#define SCAN_LOW_BITS 0x7F7F7F7F7F7F7F7FULL
+
+// the ways a byte and the one before it can break utf-8, for the avx2 validator. a byte pair is invalid when
+// every one of the three tables it's looked up in has some error bit in common
+#define SCAN_UTF8_TOO_SHORT (1 << 0)      // 11______ 0_______, 11______ 11______
+#define SCAN_UTF8_TOO_LONG (1 << 1)       // 0_______ 10______
+#define SCAN_UTF8_OVERLONG_3 (1 << 2)     // 11100000 100_____
+#define SCAN_UTF8_TOO_LARGE (1 << 3)      // 11110100 1001____, 11110100 101_____
+#define SCAN_UTF8_SURROGATE (1 << 4)      // 11101101 101_____
+#define SCAN_UTF8_OVERLONG_2 (1 << 5)     // 1100000_ 10______
+#define SCAN_UTF8_TOO_LARGE_1000 (1 << 6) // 11110101 1000____, 11111___ 1000____
+#define SCAN_UTF8_OVERLONG_4 (1 << 6)     // 11110000 1000____
+#define SCAN_UTF8_TWO_CONTS (1 << 7)      // 10______ 10______
+#define SCAN_UTF8_CARRY (SCAN_UTF8_TOO_SHORT | SCAN_UTF8_TOO_LONG | SCAN_UTF8_TWO_CONTS)
+
+// forward declarations
+int64_t
+scan_count_byte_portable(const char *bytes, int64_t byte_length, char c);
+
+int64_t
+scan_count_codepoints_portable(const char *bytes, int64_t byte_length);
+
+int64_t
+scan_find_invalid_utf8_sequences(const char *bytes, int64_t byte_length);
+
+int64_t
+scan_sequence_start(const char *bytes, int64_t i);
+
+int64_t
+scan_ascii_length(const char *bytes, int64_t byte_length);
+
+int64_t
+scan_ascii_length_portable(const char *bytes, int64_t byte_length);
+
+uint64_t
+scan_load_word(const char *bytes);
+
+#if SCAN_X86
+int64_t
+scan_count_byte_sse2(const char *bytes, int64_t byte_length, char c);
+
+int64_t
+scan_count_codepoints_sse2(const char *bytes, int64_t byte_length);
+
+int64_t
+scan_count_byte_avx2(const char *bytes, int64_t byte_length, char c);
+
+int64_t
+scan_count_codepoints_avx2(const char *bytes, int64_t byte_length);
+
+int64_t
+scan_ascii_length_sse2(const char *bytes, int64_t byte_length);
+
+int64_t
+scan_ascii_length_avx2(const char *bytes, int64_t byte_length);
+
+int64_t
+scan_find_invalid_utf8_avx2(const char *bytes, int64_t byte_length);
+#endif
+
+// methods
+int32_t
+scan_level()
+{
+    if (scan_cpu_level == SCAN_LEVEL_UNKNOWN) {
+        scan_cpu_level = SCAN_LEVEL_PORTABLE;
+
+#if SCAN_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+            scan_cpu_level = SCAN_LEVEL_AVX2;
+        } else if (__builtin_cpu_supports("sse2")) {
+            scan_cpu_level = SCAN_LEVEL_SSE2;
+        }
+#endif
+    }
+
+    return scan_cpu_level;
+}
+
+int64_t
+scan_count_byte(const char *bytes, int64_t byte_length, char c)
+{
+#if SCAN_X86
+    switch (scan_level()) {
+        case SCAN_LEVEL_AVX2: return scan_count_byte_avx2(bytes, byte_length, c);
+        case SCAN_LEVEL_SSE2: return scan_count_byte_sse2(bytes, byte_length, c);
+        default: break;
+    }
+#endif
+
+    return scan_count_byte_portable(bytes, byte_length, c);
+}
+
+int64_t
+scan_count_codepoints(const char *bytes, int64_t byte_length)
+{
+#if SCAN_X86
+    switch (scan_level()) {
+        case SCAN_LEVEL_AVX2: return scan_count_codepoints_avx2(bytes, byte_length);
+        case SCAN_LEVEL_SSE2: return scan_count_codepoints_sse2(bytes, byte_length);
+        default: break;
+    }
+#endif
+
+    return scan_count_codepoints_portable(bytes, byte_length);
+}
+
+int64_t
+scan_find_invalid_utf8(const char *bytes, int64_t byte_length)
+{
+#if SCAN_X86
+    if (scan_level() == SCAN_LEVEL_AVX2) { return scan_find_invalid_utf8_avx2(bytes, byte_length); }
+#endif
+
+    return scan_find_invalid_utf8_sequences(bytes, byte_length);
+}
+
+// skips ascii with the vector kernels, and checks everything else one sequence at a time
+int64_t
+scan_find_invalid_utf8_sequences(const char *bytes, int64_t byte_length)
+{
+    int64_t i = 0;
+    while (i < byte_length) {
+        i += scan_ascii_length(bytes + i, byte_length - i);
+
+        // then check sequences until the text is back to ascii
+        while (i < byte_length && (bytes[i] & 0x80) != 0) {
+            int32_t length;
+            if (!utf8_check_sequence(bytes + i, byte_length - i, &length)) { return i; }
+            i += length;
+        }
+    }
+
+    return byte_length;
+}
+
+// the start of the sequence bytes[i] is in, or of the one that's cut off just before i. bytes before i have
+// to be known valid already
+int64_t
+scan_sequence_start(const char *bytes, int64_t i)
+{
+    int64_t start = i;
+    while (start > 0 && i - start < 3 && (bytes[start - 1] & 0x80) != 0) { start -= 1; }
+    while (start < i && (bytes[start] & 0xC0) == 0x80) { start += 1; }
+
+    return start;
+}
+
+// how many bytes at the start of bytes are ascii
+int64_t
+scan_ascii_length(const char *bytes, int64_t byte_length)
+{
+#if SCAN_X86
+    switch (scan_level()) {
+        case SCAN_LEVEL_AVX2: return scan_ascii_length_avx2(bytes, byte_length);
+        case SCAN_LEVEL_SSE2: return scan_ascii_length_sse2(bytes, byte_length);
+        default: break;
+    }
+#endif
+
+    return scan_ascii_length_portable(bytes, byte_length);
+}
+
+// portable, eight bytes at a time
+uint64_t
+scan_load_word(const char *bytes)
+{
+    uint64_t word;
+    memcpy(&word, bytes, sizeof(word));
+    return word;
+}
+
+int64_t
+scan_count_byte_portable(const char *bytes, int64_t byte_length, char c)
+{
+    uint64_t needle = SCAN_ONES * (uint8_t) c;
+    int64_t count = 0;
+
+    int64_t i = 0;
+    for (; i + 8 <= byte_length; i += 8) {
+        // the bytes equal to c become zero, and only those end up with their high bit set here
+        uint64_t x = scan_load_word(bytes + i) ^ needle;
+        uint64_t zero = ~(((x & SCAN_LOW_BITS) + SCAN_LOW_BITS) | x | SCAN_LOW_BITS);
+
+        count += (int64_t) (((zero >> 7) * SCAN_ONES) >> 56);
+    }
+
+    for (; i < byte_length; i++) {
+        if (bytes[i] == c) { count += 1; }
+    }
+
+    return count;
+}
+
+int64_t
+scan_count_codepoints_portable(const char *bytes, int64_t byte_length)
+{
+    int64_t count = 0;
+
+    int64_t i = 0;
+    for (; i + 8 <= byte_length; i += 8) {
+        // continuation bytes are 10xxxxxx: high bit set, the one below it clear
+        uint64_t x = scan_load_word(bytes + i);
+        uint64_t continuation = x & ~(x << 1) & SCAN_HIGH_BITS;
+
+        count += 8 - (int64_t) (((continuation >> 7) * SCAN_ONES) >> 56);
+    }
+
+    for (; i < byte_length; i++) {
+        if ((bytes[i] & 0xC0) != 0x80) { count += 1; }
+    }
+
+    return count;
+}
+
+int64_t
+scan_ascii_length_portable(const char *bytes, int64_t byte_length)
+{
+    int64_t i = 0;
+    while (i + 8 <= byte_length && (scan_load_word(bytes + i) & SCAN_HIGH_BITS) == 0) { i += 8; }
+    while (i < byte_length && (bytes[i] & 0x80) == 0) { i += 1; }
+
+    return i;
+}
+
+#if SCAN_X86
+// sse2. a match is -1 in its byte lane, so subtracting matches counts them a lane at a time. a lane holds at most
+// 255, so every 255 blocks the lanes are summed into the total (psadbw) and start again
+__attribute__((target("sse2")))
+int64_t
+scan_count_byte_sse2(const char *bytes, int64_t byte_length, char c)
+{
+    __m128i needle = _mm_set1_epi8(c);
+    __m128i zero = _mm_setzero_si128();
+    int64_t count = 0;
+
+    int64_t i = 0;
+    while (i + 16 <= byte_length) {
+        int64_t batch_end = i + 255 * 16;
+        if (batch_end > byte_length) { batch_end = byte_length; }
+
+        __m128i lanes = zero;
+        for (; i + 16 <= batch_end; i += 16) {
+            __m128i block = _mm_loadu_si128((const __m128i *) (bytes + i));
+            lanes = _mm_sub_epi8(lanes, _mm_cmpeq_epi8(block, needle));
+        }
+
+        __m128i sums = _mm_sad_epu8(lanes, zero);
+        count += _mm_cvtsi128_si32(sums) + _mm_cvtsi128_si32(_mm_unpackhi_epi64(sums, sums));
+    }
+
+    return count + scan_count_byte_portable(bytes + i, byte_length - i, c);
+}
+
+__attribute__((target("sse2")))
+int64_t
+scan_count_codepoints_sse2(const char *bytes, int64_t byte_length)
+{
+    // as signed bytes, continuation bytes are the ones from -128 to -65
+    __m128i last_continuation = _mm_set1_epi8((char) 0xBF);
+    __m128i zero = _mm_setzero_si128();
+    int64_t count = 0;
+
+    int64_t i = 0;
+    while (i + 16 <= byte_length) {
+        int64_t batch_end = i + 255 * 16;
+        if (batch_end > byte_length) { batch_end = byte_length; }
+
+        __m128i lanes = zero;
+        for (; i + 16 <= batch_end; i += 16) {
+            __m128i block = _mm_loadu_si128((const __m128i *) (bytes + i));
+            lanes = _mm_sub_epi8(lanes, _mm_cmpgt_epi8(block, last_continuation));
+        }
+
+        __m128i sums = _mm_sad_epu8(lanes, zero);
+        count += _mm_cvtsi128_si32(sums) + _mm_cvtsi128_si32(_mm_unpackhi_epi64(sums, sums));
+    }
+
+    return count + scan_count_codepoints_portable(bytes + i, byte_length - i);
+}
+
+__attribute__((target("sse2")))
+int64_t
+scan_ascii_length_sse2(const char *bytes, int64_t byte_length)
+{
+    int64_t i = 0;
+    for (; i + 16 <= byte_length; i += 16) {
+        int high_bits = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *) (bytes + i)));
+        if (high_bits != 0) { return i + __builtin_ctz((unsigned int) high_bits); }
+    }
+
+    return i + scan_ascii_length_portable(bytes + i, byte_length - i);
+}
+
+// avx2. compare 64 bytes, gather the results into one bit each and popcount them
+__attribute__((target("avx2,popcnt")))
+int64_t
+scan_count_byte_avx2(const char *bytes, int64_t byte_length, char c)
+{
+    __m256i needle = _mm256_set1_epi8(c);
+    int64_t count = 0;
+
+    int64_t i = 0;
+    for (; i + 64 <= byte_length; i += 64) {
+        __m256i low = _mm256_loadu_si256((const __m256i *) (bytes + i));
+        __m256i high = _mm256_loadu_si256((const __m256i *) (bytes + i + 32));
+
+        uint64_t matches = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(low, needle))
+                           | (uint64_t) (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(high, needle)) << 32;
+        count += __builtin_popcountll(matches);
+    }
+
+    return count + scan_count_byte_portable(bytes + i, byte_length - i, c);
+}
+
+__attribute__((target("avx2,popcnt")))
+int64_t
+scan_count_codepoints_avx2(const char *bytes, int64_t byte_length)
+{
+    __m256i last_continuation = _mm256_set1_epi8((char) 0xBF);
+    int64_t count = 0;
+
+    int64_t i = 0;
+    for (; i + 64 <= byte_length; i += 64) {
+        __m256i low = _mm256_loadu_si256((const __m256i *) (bytes + i));
+        __m256i high = _mm256_loadu_si256((const __m256i *) (bytes + i + 32));
+
+        uint64_t starts = (uint32_t) _mm256_movemask_epi8(_mm256_cmpgt_epi8(low, last_continuation))
+                          | (uint64_t) (uint32_t) _mm256_movemask_epi8(_mm256_cmpgt_epi8(high, last_continuation)) << 32;
+        count += __builtin_popcountll(starts);
+    }
+
+    return count + scan_count_codepoints_portable(bytes + i, byte_length - i);
+}
+__attribute__((target("avx2,popcnt")))
+int64_t
+scan_ascii_length_avx2(const char *bytes, int64_t byte_length)
+{
+    int64_t i = 0;
+    for (; i + 32 <= byte_length; i += 32) {
+        int high_bits = _mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *) (bytes + i)));
+        if (high_bits != 0) { return i + __builtin_ctz((unsigned int) high_bits); }
+    }
+
+    return i + scan_ascii_length_portable(bytes + i, byte_length - i);
+}
+
+// each byte is checked against the three before it, looked up by its high nibble and the previous byte's
+// nibbles (Keiser and Lemire, "Validating UTF-8 in less than one instruction per byte"). the vectors only say
+// whether a block has an error in it, so the block is then gone over a sequence at a time to find where
+__attribute__((target("avx2,popcnt")))
+int64_t
+scan_find_invalid_utf8_avx2(const char *bytes, int64_t byte_length)
+{
+    __m256i byte_1_high_table = _mm256_setr_epi8(
+        SCAN_UTF8_TOO_LONG, SCAN_UTF8_TOO_LONG, SCAN_UTF8_TOO_LONG, SCAN_UTF8_TOO_LONG,
+        SCAN_UTF8_TOO_LONG, SCAN_UTF8_TOO_LONG, SCAN_UTF8_TOO_LONG, SCAN_UTF8_TOO_LONG,
+        SCAN_UTF8_TWO_CONTS, SCAN_UTF8_TWO_CONTS, SCAN_UTF8_TWO_CONTS, SCAN_UTF8_TWO_CONTS,
+        SCAN_UTF8_TOO_SHORT | SCAN_UTF8_OVERLONG_2,
+        SCAN_UTF8_TOO_SHORT,
+        SCAN_UTF8_TOO_SHORT | SCAN_UTF8_OVERLONG_3 | SCAN_UTF8_SURROGATE,
+        SCAN_UTF8_TOO_SHORT | SCAN_UTF8_TOO_LARGE | SCAN_UTF8_TOO_LARGE_1000 | SCAN_UTF8_OVERLONG_4,
+        SCAN_UTF8_TOO_LONG, SCAN_UTF8_TOO_LONG, SCAN_UTF8_TOO_LONG, SCAN_UTF8_TOO_LONG,
+        SCAN_UTF8_TOO_LONG, SCAN_UTF8_TOO_LONG, SCAN_UTF8_TOO_LONG, SCAN_UTF8_TOO_LONG,
+        SCAN_UTF8_TWO_CONTS, SCAN_UTF8_TWO_CONTS, SCAN_UTF8_TWO_CONTS, SCAN_UTF8_TWO_CONTS,
+        SCAN_UTF8_TOO_SHORT | SCAN_UTF8_OVERLONG_2,
+        SCAN_UTF8_TOO_SHORT,
+        SCAN_UTF8_TOO_SHORT | SCAN_UTF8_OVERLONG_3 | SCAN_UTF8_SURROGATE,
+        SCAN_UTF8_TOO_SHORT | SCAN_UTF8_TOO_LARGE | SCAN_UTF8_TOO_LARGE_1000 | SCAN_UTF8_OVERLONG_4);
+
+    __m256i byte_1_low_table = _mm256_setr_epi8(
+        SCAN_UTF8_CARRY | SCAN_UTF8_OVERLONG_3 | SCAN_UTF8_OVERLONG_2 | SCAN_UTF8_OVERLONG_4,
+        SCAN_UTF8_CARRY | SCAN_UTF8_OVERLONG_2,
+        SCAN_UTF8_CARRY, SCAN_UTF8_CARRY,
+        SCAN_UTF8_CARRY | SCAN_UTF8_TOO_LARGE,
+        SCAN_UTF8_CARRY | SCAN_UTF8_TOO_LARGE | SCAN_UTF8_TOO_LARGE_1000,
+        SCAN_UTF8_CARRY | SCAN_UTF8_TOO_LARGE | SCAN_UTF8_TOO_LARGE_1000,
+        SCAN_UTF8_CARRY | SCAN_UTF8_TOO_LARGE | SCAN_UTF8_TOO_LARGE_1000,
+        SCAN_UTF8_CARRY | SCAN_UTF8_TOO_LARGE | SCAN_UTF8_TOO_LARGE_1000,
+        SCAN_UTF8_CARRY | SCAN_UTF8_TOO_LARGE | SCAN_UTF8_TOO_LARGE_1000,
+        SCAN_UTF8_CARRY | SCAN_UTF8_TOO_LARGE | SCAN_UTF8_TOO_LARGE_1000,
+        SCAN_UTF8_CARRY | SCAN_UTF8_TOO_LARGE | SCAN_UTF8_TOO_LARGE_1000,
+        SCAN_UTF8_CARRY | SCAN_UTF8_TOO_LARGE | SCAN_UTF8_TOO_LARGE_1000,
+        SCAN_UTF8_CARRY | SCAN_UTF8_TOO_LARGE | SCAN_UTF8_TOO_LARGE_1000 | SCAN_UTF8_SURROGATE,
+        SCAN_UTF8_CARRY | SCAN_UTF8_TOO_LARGE | SCAN_UTF8_TOO_LARGE_1000,
+        SCAN_UTF8_CARRY | SCAN_UTF8_TOO_LARGE | SCAN_UTF8_TOO_LARGE_1000,
+        SCAN_UTF8_CARRY | SCAN_UTF8_OVERLONG_3 | SCAN_UTF8_OVERLONG_2 | SCAN_UTF8_OVERLONG_4,
+        SCAN_UTF8_CARRY | SCAN_UTF8_OVERLONG_2,
+        SCAN_UTF8_CARRY, SCAN_UTF8_CARRY,
+        SCAN_UTF8_CARRY | SCAN_UTF8_TOO_LARGE,
+        SCAN_UTF8_CARRY | SCAN_UTF8_TOO_LARGE | SCAN_UTF8_TOO_LARGE_1000,
+        SCAN_UTF8_CARRY | SCAN_UTF8_TOO_LARGE | SCAN_UTF8_TOO_LARGE_1000,
+        SCAN_UTF8_CARRY | SCAN_UTF8_TOO_LARGE | SCAN_UTF8_TOO_LARGE_1000,
+        SCAN_UTF8_CARRY | SCAN_UTF8_TOO_LARGE | SCAN_UTF8_TOO_LARGE_1000,
+        SCAN_UTF8_CARRY | SCAN_UTF8_TOO_LARGE | SCAN_UTF8_TOO_LARGE_1000,
+        SCAN_UTF8_CARRY | SCAN_UTF8_TOO_LARGE | SCAN_UTF8_TOO_LARGE_1000,
+        SCAN_UTF8_CARRY | SCAN_UTF8_TOO_LARGE | SCAN_UTF8_TOO_LARGE_1000,
+        SCAN_UTF8_CARRY | SCAN_UTF8_TOO_LARGE | SCAN_UTF8_TOO_LARGE_1000,
+        SCAN_UTF8_CARRY | SCAN_UTF8_TOO_LARGE | SCAN_UTF8_TOO_LARGE_1000 | SCAN_UTF8_SURROGATE,
+        SCAN_UTF8_CARRY | SCAN_UTF8_TOO_LARGE | SCAN_UTF8_TOO_LARGE_1000,
+        SCAN_UTF8_CARRY | SCAN_UTF8_TOO_LARGE | SCAN_UTF8_TOO_LARGE_1000);
+
+    __m256i byte_2_high_table = _mm256_setr_epi8(
+        SCAN_UTF8_TOO_SHORT, SCAN_UTF8_TOO_SHORT, SCAN_UTF8_TOO_SHORT, SCAN_UTF8_TOO_SHORT,
+        SCAN_UTF8_TOO_SHORT, SCAN_UTF8_TOO_SHORT, SCAN_UTF8_TOO_SHORT, SCAN_UTF8_TOO_SHORT,
+        SCAN_UTF8_TOO_LONG | SCAN_UTF8_OVERLONG_2 | SCAN_UTF8_TWO_CONTS | SCAN_UTF8_OVERLONG_3
+            | SCAN_UTF8_TOO_LARGE_1000 | SCAN_UTF8_OVERLONG_4,
+        SCAN_UTF8_TOO_LONG | SCAN_UTF8_OVERLONG_2 | SCAN_UTF8_TWO_CONTS | SCAN_UTF8_OVERLONG_3 | SCAN_UTF8_TOO_LARGE,
+        SCAN_UTF8_TOO_LONG | SCAN_UTF8_OVERLONG_2 | SCAN_UTF8_TWO_CONTS | SCAN_UTF8_SURROGATE | SCAN_UTF8_TOO_LARGE,
+        SCAN_UTF8_TOO_LONG | SCAN_UTF8_OVERLONG_2 | SCAN_UTF8_TWO_CONTS | SCAN_UTF8_SURROGATE | SCAN_UTF8_TOO_LARGE,
+        SCAN_UTF8_TOO_SHORT, SCAN_UTF8_TOO_SHORT, SCAN_UTF8_TOO_SHORT, SCAN_UTF8_TOO_SHORT,
+        SCAN_UTF8_TOO_SHORT, SCAN_UTF8_TOO_SHORT, SCAN_UTF8_TOO_SHORT, SCAN_UTF8_TOO_SHORT,
+        SCAN_UTF8_TOO_SHORT, SCAN_UTF8_TOO_SHORT, SCAN_UTF8_TOO_SHORT, SCAN_UTF8_TOO_SHORT,
+        SCAN_UTF8_TOO_LONG | SCAN_UTF8_OVERLONG_2 | SCAN_UTF8_TWO_CONTS | SCAN_UTF8_OVERLONG_3
+            | SCAN_UTF8_TOO_LARGE_1000 | SCAN_UTF8_OVERLONG_4,
+        SCAN_UTF8_TOO_LONG | SCAN_UTF8_OVERLONG_2 | SCAN_UTF8_TWO_CONTS | SCAN_UTF8_OVERLONG_3 | SCAN_UTF8_TOO_LARGE,
+        SCAN_UTF8_TOO_LONG | SCAN_UTF8_OVERLONG_2 | SCAN_UTF8_TWO_CONTS | SCAN_UTF8_SURROGATE | SCAN_UTF8_TOO_LARGE,
+        SCAN_UTF8_TOO_LONG | SCAN_UTF8_OVERLONG_2 | SCAN_UTF8_TWO_CONTS | SCAN_UTF8_SURROGATE | SCAN_UTF8_TOO_LARGE,
+        SCAN_UTF8_TOO_SHORT, SCAN_UTF8_TOO_SHORT, SCAN_UTF8_TOO_SHORT, SCAN_UTF8_TOO_SHORT);
+
+    __m256i low_nibble = _mm256_set1_epi8(0x0F);
+
+    // a byte 2 or 3 after a 3 or 4 byte lead has to be a continuation, which the tables can't see
+    __m256i third_byte_floor = _mm256_set1_epi8((char) (0xE0 - 0x80));
+    __m256i fourth_byte_floor = _mm256_set1_epi8((char) (0xF0 - 0x80));
+    __m256i high_bit = _mm256_set1_epi8((char) 0x80);
+
+    __m256i previous = _mm256_setzero_si256();
+
+    int64_t i = 0;
+    for (; i + 32 <= byte_length; i += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i *) (bytes + i));
+
+        // the block shifted along by 1, 2 and 3 bytes, with the end of the previous block shifted in
+        __m256i carried = _mm256_permute2x128_si256(previous, block, 0x21);
+        __m256i prev1 = _mm256_alignr_epi8(block, carried, 15);
+        __m256i prev2 = _mm256_alignr_epi8(block, carried, 14);
+        __m256i prev3 = _mm256_alignr_epi8(block, carried, 13);
+
+        __m256i byte_1_high = _mm256_shuffle_epi8(byte_1_high_table,
+                                                  _mm256_and_si256(_mm256_srli_epi16(prev1, 4), low_nibble));
+        __m256i byte_1_low = _mm256_shuffle_epi8(byte_1_low_table, _mm256_and_si256(prev1, low_nibble));
+        __m256i byte_2_high = _mm256_shuffle_epi8(byte_2_high_table,
+                                                  _mm256_and_si256(_mm256_srli_epi16(block, 4), low_nibble));
+        __m256i special_cases = _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+        __m256i must_continue = _mm256_or_si256(_mm256_subs_epu8(prev2, third_byte_floor),
+                                                _mm256_subs_epu8(prev3, fourth_byte_floor));
+        __m256i errors = _mm256_xor_si256(_mm256_and_si256(must_continue, high_bit), special_cases);
+
+        if (!_mm256_testz_si256(errors, errors)) { break; }
+
+        previous = block;
+    }
+
+    // everything before i is valid, so find the error or check the last few bytes from the sequence i is in
+    int64_t start = scan_sequence_start(bytes, i);
+    return start + scan_find_invalid_utf8_sequences(bytes + start, byte_length - start);
+}
+#endif
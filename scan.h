@@ -0,0 +1,33 @@
+#ifndef SE_SCAN_H
+#define SE_SCAN_H
+
+#include <stdint.h>
+
+// whole-buffer scans, done 32 or 16 bytes at a time where the cpu allows it (picked the first time one is
+// asked for) and 8 at a time everywhere else
+
+#define SCAN_LEVEL_UNKNOWN 0
+#define SCAN_LEVEL_PORTABLE 1
+#define SCAN_LEVEL_SSE2 2
+#define SCAN_LEVEL_AVX2 3
+
+// how many of bytes[0..byte_length) are c
+int64_t
+scan_count_byte(const char *bytes, int64_t byte_length, char c);
+
+// how many codepoints start in bytes[0..byte_length), i.e. how many bytes aren't utf-8 continuation bytes
+int64_t
+scan_count_codepoints(const char *bytes, int64_t byte_length);
+
+// where the first invalid utf-8 sequence in bytes[0..byte_length) starts, or byte_length when there isn't one.
+// with avx2 every byte, ascii or not, is checked 32 at a time, and only from the first block with an error in it
+// (or the tail) on is the text gone over a sequence at a time. at the other levels ascii is skipped over a vector
+// or word at a time, and everything else is checked a sequence at a time
+int64_t
+scan_find_invalid_utf8(const char *bytes, int64_t byte_length);
+
+// which of the kernels above gets used, one of SCAN_LEVEL_*
+int32_t
+scan_level();
+
+#endif //SE_SCAN_H
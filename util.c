@@ -3,44 +3,182 @@
 #include <stdlib.h>
 
 #include "util.h"
+#include "scan.h"
+
+int64_t buf_id;
+int64_t buf_size;
+int64_t rope_id;
+
+struct node_pool_t *rope_pool;
+struct node_pool_t *rope_leaf_pool;
+struct node_pool_t *shared_rope_pool;
+struct node_pool_t *shared_rope_leaf_pool;
+
+struct leaf_store_t *rope_leaf_store;
+
+struct rope_summary_type_t *rope_summary_types;
+int32_t rope_summary_type_count;
+int64_t rope_summary_value_count;
+
+int32_t scan_cpu_level;
+
+const uint64_t rope_hash_powers[9] = {
+    0x0000000000000001ULL, 0x0d6e8feb86659fd9ULL, 0x1bd5c50408bf9928ULL,
+    0x060b3363cfecff39ULL, 0x0cc732bab6c24b94ULL, 0x1c37e5ad5453cbe8ULL,
+    0x03e9736cd2a9cb6dULL, 0x1dc16696599438fcULL, 0x1f86b8085e5e935aULL,
+};
+
+const int8_t utf8_sequence_lengths[256] = {
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x00
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x10
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x20
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x30
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x40
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x50
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x60
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x70
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x80, continuation bytes
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x90
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0xA0
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0xB0
+    1, 1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, // 0xC0, 0xC0 and 0xC1 would only be overlong
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, // 0xD0
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, // 0xE0
+    4, 4, 4, 4, 4, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0xF0, past 0xF4 would be beyond U+10FFFF
+};
+
+const int32_t unicode_zero_width_ranges[][2] = {
+    {0x0300, 0x036F}, {0x0483, 0x0489}, {0x0591, 0x05BD}, {0x05BF, 0x05BF}, {0x05C1, 0x05C2}, {0x05C4, 0x05C5},
+    {0x05C7, 0x05C7}, {0x0610, 0x061A}, {0x064B, 0x065F}, {0x0670, 0x0670}, {0x06D6, 0x06DC}, {0x06DF, 0x06E4},
+    {0x06E7, 0x06E8}, {0x06EA, 0x06ED}, {0x0711, 0x0711}, {0x0730, 0x074A}, {0x0900, 0x0902}, {0x093A, 0x093A},
+    {0x093C, 0x093C}, {0x0941, 0x0948}, {0x094D, 0x094D}, {0x0951, 0x0957}, {0x0962, 0x0963}, {0x0E31, 0x0E31},
+    {0x0E34, 0x0E3A}, {0x0E47, 0x0E4E}, {0x1160, 0x11FF}, {0x1AB0, 0x1AFF}, {0x1DC0, 0x1DFF}, {0x200B, 0x200F},
+    {0x202A, 0x202E}, {0x2060, 0x2064}, {0x20D0, 0x20FF}, {0x302A, 0x302D}, {0x3099, 0x309A}, {0xFE00, 0xFE0F},
+    {0xFE20, 0xFE2F}, {0xFEFF, 0xFEFF}, {0xE0001, 0xE0001}, {0xE0020, 0xE007F}, {0xE0100, 0xE01EF},
+};
+const int64_t unicode_zero_width_range_count = sizeof(unicode_zero_width_ranges) / sizeof(unicode_zero_width_ranges[0]);
+
+const int32_t unicode_wide_ranges[][2] = {
+    {0x1100, 0x115F}, {0x231A, 0x231B}, {0x2329, 0x232A}, {0x23E9, 0x23EC}, {0x23F0, 0x23F0}, {0x23F3, 0x23F3},
+    {0x25FD, 0x25FE}, {0x2614, 0x2615}, {0x2648, 0x2653}, {0x267F, 0x267F}, {0x2693, 0x2693}, {0x26A1, 0x26A1},
+    {0x26AA, 0x26AB}, {0x26BD, 0x26BE}, {0x26C4, 0x26C5}, {0x26CE, 0x26CE}, {0x26D4, 0x26D4}, {0x26EA, 0x26EA},
+    {0x26F2, 0x26F3}, {0x26F5, 0x26F5}, {0x26FA, 0x26FA}, {0x26FD, 0x26FD}, {0x2705, 0x2705}, {0x270A, 0x270B},
+    {0x2728, 0x2728}, {0x274C, 0x274C}, {0x274E, 0x274E}, {0x2753, 0x2755}, {0x2757, 0x2757}, {0x2795, 0x2797},
+    {0x27B0, 0x27B0}, {0x27BF, 0x27BF}, {0x2B1B, 0x2B1C}, {0x2B50, 0x2B50}, {0x2B55, 0x2B55}, {0x2E80, 0x303E},
+    {0x3041, 0x33FF}, {0x3400, 0x4DBF}, {0x4E00, 0x9FFF}, {0xA000, 0xA4CF}, {0xA960, 0xA97F}, {0xAC00, 0xD7A3},
+    {0xF900, 0xFAFF}, {0xFE10, 0xFE19}, {0xFE30, 0xFE6F}, {0xFF00, 0xFF60}, {0xFFE0, 0xFFE6}, {0x16FE0, 0x16FE4},
+    {0x17000, 0x18AFF}, {0x1B000, 0x1B2FF}, {0x1F004, 0x1F004}, {0x1F0CF, 0x1F0CF}, {0x1F18E, 0x1F18E},
+    {0x1F191, 0x1F19A}, {0x1F200, 0x1F202}, {0x1F210, 0x1F23B}, {0x1F240, 0x1F248}, {0x1F250, 0x1F251},
+    {0x1F260, 0x1F265}, {0x1F300, 0x1F320}, {0x1F32D, 0x1F335}, {0x1F337, 0x1F37C}, {0x1F37E, 0x1F393},
+    {0x1F3A0, 0x1F3CA}, {0x1F3CF, 0x1F3D3}, {0x1F3E0, 0x1F3F0}, {0x1F3F4, 0x1F3F4}, {0x1F3F8, 0x1F43E},
+    {0x1F440, 0x1F440}, {0x1F442, 0x1F4FC}, {0x1F4FF, 0x1F53D}, {0x1F54B, 0x1F54E}, {0x1F550, 0x1F567},
+    {0x1F57A, 0x1F57A}, {0x1F595, 0x1F596}, {0x1F5A4, 0x1F5A4}, {0x1F5FB, 0x1F64F}, {0x1F680, 0x1F6C5},
+    {0x1F6CC, 0x1F6CC}, {0x1F6D0, 0x1F6D2}, {0x1F6D5, 0x1F6D7}, {0x1F6EB, 0x1F6EC}, {0x1F6F4, 0x1F6FC},
+    {0x1F7E0, 0x1F7EB}, {0x1F90C, 0x1F93A}, {0x1F93C, 0x1F945}, {0x1F947, 0x1F9FF}, {0x1FA70, 0x1FAFF},
+    {0x20000, 0x2FFFD}, {0x30000, 0x3FFFD},
+};
+const int64_t unicode_wide_range_count = sizeof(unicode_wide_ranges) / sizeof(unicode_wide_ranges[0]);
 
-// todo(chad): @Performance: make this a table lookup?
 int32_t
 bytes_in_codepoint_utf8(char first_byte)
 {
-    if (first_byte >= '\x00' && first_byte <= '\x7F') {
-        return 1;
-    }
-    if (first_byte >= '\xC2' && first_byte <= '\xDF') {
-        return 2;
-    }
-    if (first_byte >= '\xE0' && first_byte <= '\xEF') {
-        return 3;
+    // ascii is kept as a branch: walking text adds each length to the next lookup's offset, and a predicted branch
+    // lets the cpu run ahead where a table load would make every step wait on the one before
+    uint8_t lead = (uint8_t) first_byte;
+    if (lead < 0x80) { return 1; }
+
+    return utf8_sequence_lengths[lead];
+}
+
+int8_t
+utf8_check_sequence(const char *bytes, int64_t remaining, int32_t *length)
+{
+    uint8_t lead = (uint8_t) bytes[0];
+    int32_t expected = utf8_sequence_lengths[lead];
+
+    *length = 1;
+    if (lead < 0x80) { return 1; }
+    if (expected == 1) { return 0; }
+
+    // the range for the second byte also rules out overlong forms, surrogates and anything past U+10FFFF
+    uint8_t low = 0x80;
+    uint8_t high = 0xBF;
+    if (lead == 0xE0) {
+        low = 0xA0;
+    } else if (lead == 0xED) {
+        high = 0x9F;
+    } else if (lead == 0xF0) {
+        low = 0x90;
+    } else if (lead == 0xF4) {
+        high = 0x8F;
     }
-    if (first_byte >= '\xF0' && first_byte <= '\xF4') {
-        return 4;
+
+    int32_t k = 1;
+    while (k < expected && k < remaining) {
+        uint8_t b = (uint8_t) bytes[k];
+        if (b < low || b > high) { break; }
+
+        low = 0x80;
+        high = 0xBF;
+        k += 1;
     }
-//    return 1;
 
-    SE_UNREACHABLE();
+    *length = k;
+    return k == expected;
 }
 
-int64_t
-unicode_strlen(const char *str)
+int32_t
+utf8_decode(const char *bytes)
 {
-    int64_t count = 0;
+    uint8_t lead = (uint8_t) bytes[0];
+    int32_t length = utf8_sequence_lengths[lead];
+    if (length == 1) { return lead; }
+
+    // the lead byte keeps 7 - length bits of the codepoint, and each continuation byte 6 more
+    int32_t codepoint = lead & (0x7F >> length);
+    for (int32_t k = 1; k < length; k++) {
+        codepoint = (codepoint << 6) | ((uint8_t) bytes[k] & 0x3F);
+    }
 
-    const char *c = str;
-    while (*c != 0) {
-        int32_t bytes = bytes_in_codepoint_utf8(*c);
-        for (int32_t i = 0; i < bytes; i++) {
-            SE_ASSERT_MSG(c + i != NULL, "malformed utf-8!");
+    return codepoint;
+}
+
+int8_t
+unicode_in_ranges(const int32_t ranges[][2], int64_t range_count, int32_t codepoint)
+{
+    int64_t low = 0;
+    int64_t high = range_count - 1;
+    while (low <= high) {
+        int64_t mid = (low + high) / 2;
+        if (codepoint < ranges[mid][0]) {
+            high = mid - 1;
+        } else if (codepoint > ranges[mid][1]) {
+            low = mid + 1;
+        } else {
+            return 1;
         }
-        c += bytes;
-        count += 1;
     }
 
-    return count;
+    return 0;
+}
+
+int32_t
+unicode_display_width(int32_t codepoint)
+{
+    // nothing before the combining diacritics is zero width or wide
+    if (codepoint < 0x300) { return 1; }
+
+    // the zero width ranges go first, as a few combining marks sit inside the wide ones
+    if (unicode_in_ranges(unicode_zero_width_ranges, unicode_zero_width_range_count, codepoint)) { return 0; }
+    if (unicode_in_ranges(unicode_wide_ranges, unicode_wide_range_count, codepoint)) { return 2; }
+
+    return 1;
+}
+
+int64_t
+unicode_strlen(const char *str)
+{
+    return scan_count_codepoints(str, (int64_t) strlen(str));
 }
 
 void *
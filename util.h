@@ -2,6 +2,7 @@
 #define SE_UTIL_H
 
 #include <assert.h>
+#include <stdint.h>
 
 #define SE_ASSERT(cond) assert(cond)
 #define SE_ASSERT_MSG(cond, msg) SE_ASSERT(cond && msg)
@@ -9,14 +10,69 @@
 #define SE_UNREACHABLE() SE_PANIC("unreachable"); exit(1)
 #define SE_TODO() SE_PANIC("todo"); exit(1)
 
-int64_t buf_id;
-int64_t buf_size;
-int64_t rope_id;
-int64_t line_rope_id;
+extern int64_t buf_id;
+extern int64_t buf_size;
+extern int64_t rope_id;
+
+// the pools new rope nodes come from (rope leaves are smaller, so they get a pool of their own).
+// an editor_buffer points these at its own pools before it edits; while they're NULL, nodes come from the
+// shared pools that everything else uses
+extern struct node_pool_t *rope_pool;
+extern struct node_pool_t *rope_leaf_pool;
+extern struct node_pool_t *shared_rope_pool;
+extern struct node_pool_t *shared_rope_leaf_pool;
+
+// the leaves text that goes into a rope can share rather than copy (see rope_leaf_store_set_enabled), or NULL
+// while there isn't one
+extern struct leaf_store_t *rope_leaf_store;
+
+// every summary registered with rope_summary_register, and how many int64s they take per node between them
+extern struct rope_summary_type_t *rope_summary_types;
+extern int32_t rope_summary_type_count;
+extern int64_t rope_summary_value_count;
+
+// the base rope hashes are taken in, to the powers 0 through 8 (see rope_hash_bytes)
+#define ROPE_HASH_PRIME (((uint64_t) 1 << 61) - 1)
+extern const uint64_t rope_hash_powers[9];
+
+// which scan kernels this cpu can run (SCAN_LEVEL_*), worked out the first time scan_level is called
+extern int32_t scan_cpu_level;
+
+// U+FFFD, which takes the place of any invalid utf-8 in text that goes into a rope
+#define UTF8_REPLACEMENT_CHAR "\xEF\xBF\xBD"
+
+// the length of the utf-8 sequence each byte starts. bytes that can't start one are 1, so stepping
+// through any text always moves forward
+extern const int8_t utf8_sequence_lengths[256];
 
 int
 bytes_in_codepoint_utf8(char first_byte);
 
+// 1 when bytes starts a complete, valid utf-8 sequence, and length is set to its length. otherwise 0, and
+// length is set to how many bytes make up the invalid sequence: the longest start of one that could still
+// have been valid, or 1
+int8_t
+utf8_check_sequence(const char *bytes, int64_t remaining, int32_t *length);
+
+// the codepoint a valid utf-8 sequence encodes
+int32_t
+utf8_decode(const char *bytes);
+
+// sorted, non-overlapping [first, last] codepoint ranges of the chars that take up no columns when text is displayed
+// (combining marks, zero width spaces and joiners, variation selectors) and of the ones that take up two (east asian
+// wide and fullwidth chars, and emoji)
+extern const int32_t unicode_zero_width_ranges[][2];
+extern const int64_t unicode_zero_width_range_count;
+extern const int32_t unicode_wide_ranges[][2];
+extern const int64_t unicode_wide_range_count;
+
+int8_t
+unicode_in_ranges(const int32_t ranges[][2], int64_t range_count, int32_t codepoint);
+
+// how many columns a codepoint takes up: 0, 2, or 1 for everything else
+int32_t
+unicode_display_width(int32_t codepoint);
+
 int64_t
 unicode_strlen(const char *str);
 